@@ -0,0 +1,299 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#include "VGJS.h"
+#include "VGJSCoro.h"
+
+using namespace std::chrono;
+
+
+/**
+* \brief Benchmark suite writing machine readable results.
+*
+* Each benchmark runs once for every thread count, on a freshly started job system.
+* Results are printed as CSV (default) or JSON, so they can be compared across releases.
+*
+* Usage: benchmark [--format csv|json] [--threads 1,2,4,...] [--out file] [--quick]
+*/
+namespace bench {
+
+	using namespace vgjs;
+
+	std::atomic<uint64_t> g_allocations{ 0 };	//heap allocations, counted by the global operator new below
+
+	struct result_t {
+		std::string m_name;		//name of the benchmark
+		int			m_threads;	//number of worker threads
+		double		m_value;	//measured value
+		std::string m_unit;		//unit of the value
+	};
+
+	std::vector<result_t> g_results;	//only written by one job or the main thread at a time
+	int g_scale = 1;					//divides the problem sizes for quick runs
+
+	void record(std::string name, double value, std::string unit) {
+		g_results.push_back({ std::move(name), JobSystem().get_thread_count().value, value, std::move(unit) });
+	}
+
+	/**
+	* \brief Record median and 99th percentile of a set of samples.
+	* \param[in] name Base name of the benchmark.
+	* \param[in] samples Samples in nanoseconds, will be sorted.
+	*/
+	void record_percentiles(const std::string& name, std::vector<double>& samples) {
+		if (samples.empty()) return;
+		std::sort(samples.begin(), samples.end());
+		record(name + "_median", samples[samples.size() / 2], "ns");
+		record(name + "_p99", samples[std::min(samples.size() - 1, samples.size() * 99 / 100)], "ns");
+	}
+
+	double ns_since(high_resolution_clock::time_point start) {
+		return (double)duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+	}
+
+	uint64_t total_steals() {
+		uint64_t steals = 0;
+		for (auto& t : get_metrics().m_threads) steals += t.m_steals;
+		return steals;
+	}
+
+	void noop() {}
+
+	void func(std::atomic<int>* atomic_int, int i = 1) {
+		if (i > 1) schedule([=]() { func(atomic_int, i - 1); });
+		if (i > 0) (*atomic_int)++;
+	}
+
+	Coro<> coro_noop() {
+		co_return;
+	}
+
+	Coro<> coro_void(std::atomic<int>* atomic_int, int i = 1) {
+		if (i > 1) co_await coro_void(atomic_int, i - 1);
+		if (i > 0) (*atomic_int)++;
+		co_return;
+	}
+
+	/**
+	* \brief Time from scheduling a job until its parent coro is resumed.
+	*/
+	Coro<> bench_latency() {
+		int num = 10000 / g_scale;
+		std::vector<double> samples;
+		samples.reserve(num);
+		for (int i = 0; i < num; ++i) {
+			auto start = high_resolution_clock::now();
+			co_await Function{ []() {} };
+			samples.push_back(ns_since(start));
+		}
+		record_percentiles("latency_co_await", samples);
+		co_return;
+	}
+
+	/**
+	* \brief Many small jobs scheduled as one batch and awaited together.
+	*/
+	Coro<> bench_fan_out() {
+		int num = 100000 / g_scale;
+		std::pmr::vector<pfvoid> jobs(num, noop);
+		co_await jobs;		//heat up the Job pools
+
+		uint64_t allocs = g_allocations.load();
+		auto start = high_resolution_clock::now();
+		co_await jobs;
+		double ns = ns_since(start);
+		uint64_t allocated = g_allocations.load() - allocs;
+		record("fan_out_functions", num / ns * 1e9, "jobs/s");
+		record("allocations_per_function", (double)allocated / num, "allocs/job");
+
+		int num_coros = num / 10;
+		std::pmr::vector<Coro<>> coros;
+		coros.reserve(num_coros);
+		allocs = g_allocations.load();
+		start = high_resolution_clock::now();
+		for (int i = 0; i < num_coros; ++i) coros.emplace_back(coro_noop());
+		co_await coros;
+		ns = ns_since(start);
+		allocated = g_allocations.load() - allocs;
+		record("fan_out_coros", num_coros / ns * 1e9, "jobs/s");
+		record("allocations_per_coro", (double)allocated / num_coros, "allocs/job");
+		co_return;
+	}
+
+	/**
+	* \brief Chains of children, each level waits for the next one.
+	*/
+	Coro<> bench_recursion() {
+		int depth = 1000;
+		int repeat = 20 / g_scale + 1;
+		std::atomic<int> counter{ 0 };
+
+		auto start = high_resolution_clock::now();
+		for (int i = 0; i < repeat; ++i) co_await coro_void(&counter, depth);
+		record("recursion_coro", ns_since(start) / (repeat * depth), "ns/level");
+
+		start = high_resolution_clock::now();
+		for (int i = 0; i < repeat; ++i) co_await [&]() { func(&counter, depth); };
+		record("recursion_function", ns_since(start) / (repeat * depth), "ns/level");
+		co_return;
+	}
+
+	/**
+	* \brief Cost of a tag barrier, with one job and with one job per thread.
+	*/
+	Coro<> bench_tags() {
+		int num = 1000 / g_scale;
+		int threads = JobSystem().get_thread_count().value;
+
+		std::vector<int> sizes{ 1 };
+		if (threads > 1) sizes.push_back(threads);
+
+		for (int jobs : sizes) {
+			std::vector<double> samples;
+			samples.reserve(num);
+			for (int i = 0; i < num; ++i) {
+				for (int j = 0; j < jobs; ++j) schedule(Function{ []() {} }, tag_t{ 1 });
+				auto start = high_resolution_clock::now();
+				co_await tag_t{ 1 };
+				samples.push_back(ns_since(start));
+			}
+			record_percentiles(jobs == 1 ? "tag_barrier_1_job" : "tag_barrier_job_per_thread", samples);
+		}
+		co_return;
+	}
+
+	/**
+	* \brief One thread produces all jobs into its deque, all others have to steal them.
+	*/
+	Coro<> bench_steal() {
+		int num = 100000 / g_scale;
+		uint64_t steals = total_steals();
+		auto start = high_resolution_clock::now();
+		co_await [=]() { for (int i = 0; i < num; ++i) schedule(noop); };
+		double ns = ns_since(start);
+		record("steal_contention", num / ns * 1e9, "jobs/s");
+		record("steals_per_job", (double)(total_steals() - steals) / num, "steals/job");
+		co_return;
+	}
+
+	Coro<> run_benchmarks() {
+		co_await bench_latency();
+		co_await bench_fan_out();
+		co_await bench_recursion();
+		co_await bench_tags();
+		co_await bench_steal();
+		co_return;
+	}
+
+	/**
+	* \brief Start a job system, run all benchmarks on it and shut it down.
+	* \param[in] threads Number of worker threads.
+	*/
+	void run(int threads) {
+		auto start = high_resolution_clock::now();
+		JobSystem js(thread_count_t{ threads });
+		schedule_and_wait(Function{ []() {} });
+		record("cold_start", ns_since(start) / 1000.0, "us");
+
+		int num = 1000 / g_scale;
+		std::vector<double> samples;
+		samples.reserve(num);
+		for (int i = 0; i < num; ++i) {
+			start = high_resolution_clock::now();
+			schedule_and_wait(Function{ []() {} });	//wakes up the sleeping main thread
+			samples.push_back(ns_since(start));
+		}
+		record_percentiles("latency_external", samples);
+
+		schedule_and_wait(run_benchmarks());
+
+		start = high_resolution_clock::now();
+		terminate();
+		wait_for_termination();
+		g_results.push_back({ "shutdown", threads, ns_since(start) / 1000.0, "us" });
+	}
+
+	void write_csv(std::ostream& out) {
+		out << "benchmark,threads,value,unit\n";
+		for (auto& r : g_results) {
+			out << r.m_name << "," << r.m_threads << "," << r.m_value << "," << r.m_unit << "\n";
+		}
+	}
+
+	void write_json(std::ostream& out) {
+		out << "{\n  \"library\": \"vgjs\",\n  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+		for (size_t i = 0; i < g_results.size(); ++i) {
+			auto& r = g_results[i];
+			out << "    { \"benchmark\": \"" << r.m_name << "\", \"threads\": " << r.m_threads
+				<< ", \"value\": " << r.m_value << ", \"unit\": \"" << r.m_unit << "\" }" << (i + 1 < g_results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+};
+
+
+void* operator new(std::size_t size) {
+	bench::g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = malloc(size == 0 ? 1 : size)) return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	free(p);
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string format = "csv";
+	std::string out_file;
+	std::vector<int> threads{ 1, 2, 4, 8, 16, 32, 64 };
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc) {
+			format = argv[++i];
+		}
+		else if (arg == "--out" && i + 1 < argc) {
+			out_file = argv[++i];
+		}
+		else if (arg == "--threads" && i + 1 < argc) {
+			threads.clear();
+			std::stringstream list(argv[++i]);
+			std::string n;
+			while (std::getline(list, n, ',')) threads.push_back(std::max(std::stoi(n), 1));
+		}
+		else if (arg == "--quick") {
+			bench::g_scale = 10;
+		}
+		else {
+			std::cout << "Usage: " << argv[0] << " [--format csv|json] [--threads 1,2,4,...] [--out file] [--quick]\n";
+			return 1;
+		}
+	}
+
+	for (int n : threads) {
+		std::cerr << "Running on " << n << " threads\n";
+		bench::run(n);
+	}
+
+	std::ofstream file;
+	if (!out_file.empty()) file.open(out_file);
+	std::ostream& out = out_file.empty() ? std::cout : file;
+	if (format == "json") bench::write_json(out);
+	else bench::write_csv(out);
+	return 0;
+}
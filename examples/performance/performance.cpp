@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <chrono>
 #include <numeric>
+#include <cmath>
 
 #include "VGJS.h"
 #include "VGJSCoro.h"
@@ -28,8 +29,6 @@ namespace test {
 	auto				g_global_mem_c = n_pmr::synchronized_pool_resource({ .max_blocks_per_chunk = num_blocks, .largest_required_pool_block = block_size }, n_pmr::new_delete_resource());
 	thread_local auto	g_local_mem_c = n_pmr::unsynchronized_pool_resource({ .max_blocks_per_chunk = num_blocks, .largest_required_pool_block = block_size }, n_pmr::new_delete_resource());
 
-	thread_local auto	g_local_mem_m = n_pmr::monotonic_buffer_resource( 1<<20, n_pmr::new_delete_resource());
-
 	void func(std::atomic<int>* atomic_int, int i = 1) {
 		if (i > 1) schedule([=]() { func(atomic_int, i - 1); });
 		if (i > 0) (*atomic_int)++;
@@ -221,6 +220,7 @@ namespace test {
 		for (int us = st; us <= mt; us += mdt) {
 			int loops = (us == 0 ? num : (runtime / us));
 			auto [speedup, eff] = co_await performance_function<WITHALLOCATE,FT1,FT2>(true, wrt_function, loops, us, mr);
+			next_frame();	//frame resource: memory of the run before the previous one is reused
 			if (eff > 0.95) co_return;
 			if (us >= 15) mdt = dt2;
 			if (us >= 20) mdt = dt3;
@@ -230,6 +230,20 @@ namespace test {
 	}
 
 
+	template<typename FT1, typename FT2>
+	Coro<> performance_small_jobs(std::string text, int runtime = 400000) {
+		JobSystem js;
+
+		std::cout << "\nEfficiency for small jobs, " << text << " on " << js.get_thread_count().value << " threads\n\n";
+		co_await performance_function<false, FT1, FT2>(false, true, runtime, 0); //heat up, allocate enough jobs
+		for (int us = 1; us <= 10; ++us) {
+			auto [speedup, eff] = co_await performance_function<false, FT1, FT2>(false, true, runtime / us, us);
+			std::cout << "Work/job " << std::right << std::setw(3) << us << " us Speedup " << std::left << std::setw(8) << speedup << " Efficiency " << std::setw(8) << eff << std::endl;
+		}
+		co_return;
+	}
+
+
 	Coro<> start_test() {
 		int number = 0;
 		std::atomic<int> counter = 0;
@@ -238,28 +252,30 @@ namespace test {
 		std::cout << "\n\nTest utilization drop\n";
 		co_await test_utilization_drop(4);		
 
+		std::cout << "\n\nEfficiency of the work stealing deques for jobs of 1-10 microseconds\n";
+		co_await performance_small_jobs<pfvoid, pfvoid>("void(*)() calls (w / o allocate)");
+		co_await performance_small_jobs<Function, std::function<void(void)>>("std::function calls (w / o allocate)");
+
 		std::cout << "\n\nPerformance: min work (in microsconds) per job so that efficiency is >0.85 or >0.95\n";
 
 		co_await performance_driver<false,pfvoid, pfvoid>("void(*)() calls (w / o allocate)");
 		//co_await performance_driver<true, pfvoid, pfvoid>("void(*)() calls (with allocate new/delete)", std::pmr::new_delete_resource());
 		co_await performance_driver<true, pfvoid, pfvoid>("void(*)() calls (with allocate synchronized)", &g_global_mem_f);
 		//co_await performance_driver<true, pfvoid, pfvoid>("void(*)() calls (with allocate unsynchronized)", &g_local_mem_f);
-		//co_await performance_driver<true, pfvoid, pfvoid>("void(*)() calls (with allocate monotonic)", &g_local_mem_m);
-		//g_local_mem_m.release();
+		//co_await performance_driver<true, pfvoid, pfvoid>("void(*)() calls (with allocate frame resource)", frame_resource());
 
 		co_await performance_driver<false,Function, std::function<void(void)>>("std::function calls (w / o allocate)" );
 		//co_await performance_driver<true, Function, std::function<void(void)>>("std::function calls (with allocate new/delete)", std::pmr::new_delete_resource());
 		co_await performance_driver<true, Function, std::function<void(void)>>("std::function calls (with allocate synchronized)", &g_global_mem_f);
 		//co_await performance_driver<true, Function, std::function<void(void)>>("std::function calls (with allocate unsynchronized)", &g_local_mem_f);
-		//co_await performance_driver<true, Function, std::function<void(void)>>("std::function calls (with allocate monotonic)", &g_local_mem_m);
-		//g_local_mem_m.release();
+		//co_await performance_driver<true, Function, std::function<void(void)>>("std::function calls (with allocate frame resource)", frame_resource());
 
 		co_await performance_driver<false,Coro<>, Coro<>>("Coro<> calls (w / o allocate)");
 		//co_await performance_driver<true, Coro<>, Coro<>>("Coro<> calls (with allocate new/delete)", std::pmr::new_delete_resource());
 		co_await performance_driver<true, Coro<>, Coro<>>("Coro<> calls (with allocate synchronized)", &g_global_mem_c);
+		co_await performance_driver<true, Coro<>, Coro<>>("Coro<> calls (with allocate coro frame resource)", coro_frame_resource());
 		//co_await performance_driver<true, Coro<>, Coro<>>("Coro<> calls (with allocate unsynchronized)", &g_local_mem_c);
-		//co_await performance_driver<true, Coro<>, Coro<>>("Coro<> calls (with allocate monotonic)", &g_local_mem_m);
-		//g_local_mem_m.release();
+		co_await performance_driver<true, Coro<>, Coro<>>("Coro<> calls (with allocate frame resource)", frame_resource());
 
 		std::cout << "\n\nTest utilization drop\n";
 		co_await test_utilization_drop(4);
@@ -6,9 +6,12 @@
 #include <algorithm>
 #include <chrono>
 #include <numeric>
+#include <fstream>
 
 #include "VGJS.h"
 #include "VGJSCoro.h"
+#include "VGJSIO.h"
+#include "VGJSRemote.h"
 
 using namespace std::chrono;
 
@@ -28,7 +31,27 @@ namespace test {
 	auto				g_global_mem_c = n_pmr::synchronized_pool_resource({ .max_blocks_per_chunk = num_blocks, .largest_required_pool_block = block_size }, n_pmr::new_delete_resource());
 	thread_local auto	g_local_mem_c = n_pmr::unsynchronized_pool_resource({ .max_blocks_per_chunk = num_blocks, .largest_required_pool_block = block_size }, n_pmr::new_delete_resource());
 
-	thread_local auto	g_local_mem_m = n_pmr::monotonic_buffer_resource( 1<<20, n_pmr::new_delete_resource());
+	class counting_resource_t : public n_pmr::memory_resource {	//counts the blocks that are allocated but not freed
+	public:
+		std::atomic<int> m_blocks = 0;
+	protected:
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override { ++m_blocks; return n_pmr::new_delete_resource()->allocate(bytes, alignment); }
+		void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override { --m_blocks; n_pmr::new_delete_resource()->deallocate(p, bytes, alignment); }
+		bool do_is_equal(const n_pmr::memory_resource& other) const noexcept override { return this == &other; }
+	};
+
+	counting_resource_t	g_counting_mem;
+	CoroFrameResource	g_frame_mem(&g_counting_mem);	//a second frame resource besides the default one
+
+	int frame_resource_blocks() {	//frames freed to one CoroFrameResource must not be handed out by another one
+		void* p = coro_frame_resource()->allocate(4000);
+		coro_frame_resource()->deallocate(p, 4000);		//cached by the default resource
+		int before = g_counting_mem.m_blocks.load();
+		void* q = g_frame_mem.allocate(4000);
+		int blocks = g_counting_mem.m_blocks.load() - before;
+		g_frame_mem.deallocate(q, 4000);
+		return q != p ? blocks : -1;
+	}
 
 	void func(std::atomic<int>* atomic_int, int i = 1) {
 		if (i > 1) schedule([=]() { func(atomic_int, i - 1); });
@@ -52,6 +75,204 @@ namespace test {
 		co_return ret;
 	}
 
+	Coro<int> coro_cancel(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		co_await [=]() { (*atomic_int)++; };	//is skipped if the token of the coro was cancelled
+		if (co_await cancel_check_t{}) co_return -1;
+		co_return 1;
+	}
+
+	Coro<int> coro_io(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		const std::string name = "vgjs_io_test.tmp";
+		char out[] = "vienna game job system";
+		char in[sizeof(out)] = {};
+		io_handle_t file = io_open(name, true);
+		if (!io_valid(file)) co_return -1;
+		int64_t written = co_await write(file, std::as_bytes(std::span{ out }), 0);
+		int64_t read_bytes = co_await read(file, std::as_writable_bytes(std::span{ in }), 0);
+		io_close(file);
+		std::remove(name.c_str());
+		if (written == sizeof(out) && read_bytes == sizeof(out) && std::string(in) == out) (*atomic_int)++;
+		co_return (int)read_bytes;
+	}
+
+	Coro<int64_t> coro_pipeline(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		const std::string name = "vgjs_pipeline_test.tmp";
+		{
+			std::ofstream out(name);
+			for (int i = 0; i < 1000; ++i) out << i << "\n";
+		}
+		int expected = 0;	//first number of the next chunk
+		auto parse = [](std::string_view chunk) {
+			std::pair<int, int> range{ -1, -1 };	//first and last number in the chunk
+			for (std::size_t pos = 0; pos < chunk.size(); pos = chunk.find('\n', pos) + 1) {
+				int value = std::stoi(std::string(chunk.substr(pos, chunk.find('\n', pos) - pos)));
+				if (range.first < 0) range.first = value;
+				range.second = value;
+			}
+			return range;
+		};
+		auto consume = [&](std::pair<int, int>&& range) {
+			if (range.first == expected) (*atomic_int)++;
+			expected = range.second + 1;
+		};
+		int64_t chunks = co_await process_file(name, parse, consume, file_pipeline_t{ .m_chunk_size = 100, .m_in_flight = 4 });
+		std::remove(name.c_str());
+		co_return expected == 1000 ? chunks : -1;
+	}
+
+	Coro<> coro_producer(Channel<int>& channel, int num) {
+		for (int i = 1; i <= num; ++i) co_await channel.push(i);
+		co_return;
+	}
+
+	Coro<> coro_consumer(Channel<int>& channel, std::atomic<int>* atomic_int) {
+		while (auto value = co_await channel.pop()) (*atomic_int) += *value;
+		co_return;
+	}
+
+	Coro<> coro_close(Channel<int>& channel, n_pmr::vector<Coro<>>& producers) {
+		co_await producers;
+		channel.close();	//consumers stop when the channel is empty
+		co_return;
+	}
+
+	Coro<int> coro_channel(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		Channel<int> channel(2);
+		n_pmr::vector<Coro<>> producers;
+		n_pmr::vector<Coro<>> consumers;
+		for (int i = 0; i < 3; ++i) producers.emplace_back(coro_producer(channel, 100));
+		for (int i = 0; i < 2; ++i) consumers.emplace_back(coro_consumer(channel, atomic_int));
+		co_await parallel(coro_close(channel, producers), consumers);
+		co_return channel.try_pop().has_value() ? -1 : 1;
+	}
+
+	Coro<int> coro_add_one(int i) {
+		co_return i + 1;
+	}
+
+	Coro<int> coro_pipeline_stages(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		int next = 0;
+		int last = 1;
+		co_await pipeline(4
+			, [&]() -> std::optional<int> { if (next < 100) return ++next; return std::nullopt; }
+			, [](int&& i) { return i * 2; }
+			, [](int&& i) { return coro_add_one(i); }
+			, [&](int&& i) { if (i == last + 2) (*atomic_int)++; last = i; });	//items arrive in order
+		co_return last;
+	}
+
+	void keep_busy(int thread) {	//queue independent work on the thread ahead of the parent, so a stealable parent is stolen meanwhile
+		schedule(Function{ []() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }, thread_index_t{ thread } }, tag_t{}, nullptr);
+	}
+
+	Coro<int> coro_placement(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		JobSystem js;
+		int last = js.get_thread_count().value - 1;
+		co_await placement_last_child;		//resume where the child finished
+		co_await Function{ [=]() { keep_busy(last); (*atomic_int)++; }, thread_index_t{ last } };
+		int here = js.get_thread_index().value;
+		co_await placement_any;
+		co_return here == last ? 1 : 0;
+	}
+
+	void func_placement(std::atomic<int>* atomic_int, std::atomic<int>* thread) {
+		int last = JobSystem().get_thread_count().value - 1;
+		schedule(Function{ [=]() { keep_busy(last); (*atomic_int)++; }, thread_index_t{ last } });
+		continuation(Function{ [=]() { *thread = JobSystem().get_thread_index().value; }
+			, placement_last_child });
+	}
+
+	alignas(64) std::array<float, 1000> g_soa_pos;
+	alignas(64) std::array<double, 1000> g_soa_vel;
+
+	Coro<int> coro_batch(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		g_soa_pos.fill(1.0f);
+		g_soa_vel.fill(2.0);
+		co_await parallel_batch(10, [=](std::size_t begin, std::size_t end, aligned_span_t<float> pos, aligned_span_t<const double> vel) {
+			if (begin % 16 != 0) return;			//64 bytes are 16 floats and 8 doubles
+			for (std::size_t i = begin; i < end; ++i) pos[i] += (float)vel[i];
+			(*atomic_int) += (int)(end - begin);
+		}, std::span(g_soa_pos), std::span<const double>(g_soa_vel));
+		co_return (int)std::accumulate(g_soa_pos.begin(), g_soa_pos.end(), 0.0f);
+	}
+
+	void spin_for(uint64_t ns) {
+		uint64_t start = trace_nanoseconds();
+		while (trace_nanoseconds() < start + ns) cpu_pause();
+	}
+
+	Coro<int> coro_defer(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		set_frame_budget(frame_budget_t{ std::chrono::microseconds(1), std::chrono::microseconds(0), tag_t{ 7 } });
+		next_frame();
+		spin_for(20000);						//the frame budget is spent
+		co_await Function{ [=]() { (*atomic_int)++; }, budget_t{ std::chrono::microseconds(-1), true } };
+		int before = atomic_int->load();		//deferred, not run yet
+		set_frame_budget(frame_budget_t{});
+		co_await tag_t{ 7 };					//run it in the next frame
+		co_return before;
+	}
+
+	Coro<int> coro_deadline(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		next_frame();
+		co_await Function{ [=]() { spin_for(10000); (*atomic_int)++; }, budget_t{ std::chrono::microseconds(0) }, thread_type_t{ 3 } };
+		next_frame();
+		int missed = 0;
+		for (auto& [type, num] : get_frame_report().m_missed) if (type.value == 3) missed += (int)num;
+		co_return missed;
+	}
+
+	Coro<int> coro_late(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		for (int i = 0; i < 3; ++i) co_await Function{ [=]() { spin_for(10000); (*atomic_int)++; } };	//resumed after its deadline each time
+		co_return 0;
+	}
+
+	Coro<int> coro_deadline_once(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		next_frame();
+		co_await coro_late(std::allocator_arg, mr, atomic_int)(budget_t{ std::chrono::microseconds(0) }, thread_type_t{ 4 });
+		next_frame();
+		int missed = 0;
+		for (auto& [type, num] : get_frame_report().m_missed) if (type.value == 4) missed += (int)num;
+		co_return missed;
+	}
+
+	Coro<int> coro_remote(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		register_remote<int>(thread_type_t{ 20 }, [=](const int& x) { (*atomic_int)++; return 2 * x; });
+		RemoteNode node;
+		RemoteExecutor executor;
+		if (!node.is_listening() || !executor.connect("127.0.0.1", node.port())) co_return -1;
+
+		n_pmr::vector<Coro<std::optional<int>>> calls;
+		for (int i = 0; i < 100; ++i) calls.emplace_back(remote<int>(executor, thread_type_t{ 20 }, i));
+		co_await calls;							//sent in batches, awaited like local children
+		int sum = 0;
+		for (auto& call : calls) sum += call.get().value_or(-1000);
+
+		auto unknown = co_await remote<int>(executor, thread_type_t{ 21 }, 1);
+		if (unknown.has_value()) co_return -2;
+		co_return sum;
+	}
+
+	Coro<int> coro_remote_frames(std::allocator_arg_t, n_pmr::memory_resource* mr, std::atomic<int>* atomic_int) {
+		register_remote<int>(thread_type_t{ 22 }, [=](const int& n) { (*atomic_int)++; return remote_bytes_t((std::size_t)n, std::byte{ 1 }); });
+		remote_node_options_t options;
+		options.m_max_frame = c_remote_min_frame;
+		RemoteNode node(options);
+		RemoteExecutor executor(c_remote_min_frame);				//results of many calls must be split into small frames
+		if (!node.is_listening() || !executor.connect("127.0.0.1", node.port())) co_return -1;
+
+		n_pmr::vector<Coro<std::optional<remote_bytes_t>>> calls;
+		for (int i = 0; i < 50; ++i) calls.emplace_back(remote<remote_bytes_t>(executor, thread_type_t{ 22 }, 1000));
+		co_await calls;
+		int num = 0;
+		for (auto& call : calls) if (call.get() && call.get()->size() == 1000) ++num;
+
+		auto big_result = co_await executor.call(thread_type_t{ 22 }, remote_encode(2 * (int)c_remote_min_frame));
+		auto big_job = co_await executor.call(thread_type_t{ 22 }, remote_bytes_t(2 * c_remote_min_frame));
+		auto after = co_await remote<remote_bytes_t>(executor, thread_type_t{ 22 }, 10);	//the link is still there
+		if (big_result.m_status != remote_too_large || big_job.m_status != remote_too_large || !after) co_return -2;
+		co_return num;
+	}
+
 	Coro<float> coro_float(std::atomic<int>* atomic_int, float f = 1.0f) {
 		while (true) {
 			(*atomic_int)++;
@@ -210,6 +431,17 @@ namespace test {
 		vci4.emplace_back(coro_int(std::allocator_arg, &g_global_mem, &counter, 10));
 		TESTRESULT(++number, "Vector 10 Coro<int>", auto rvci4 = co_await vci4, std::accumulate(rvci4.begin(), rvci4.end(), 0) == 20 && counter.load() == 20, counter = 0);
 
+		std::pmr::vector<Function> vf_wide(1000, Function{ [&]() { counter++; } });	//children report in groups
+		TESTRESULT(++number, "Wide vector Functions", co_await vf_wide, counter.load() == 1000, counter = 0);
+		TESTRESULT(++number, "Wide vector in parallel", co_await parallel(vf_wide, vf2), counter.load() == 1020, counter = 0);
+		std::pmr::vector<Coro<int>> vci_wide;
+		for (int i = 0; i < 200; ++i) vci_wide.emplace_back(coro_int(std::allocator_arg, &g_global_mem, &counter, 1));
+		TESTRESULT(++number, "Wide vector Coro<int>", auto rvciw = co_await vci_wide, std::accumulate(rvciw.begin(), rvciw.end(), 0) == 200 && counter.load() == 200, counter = 0);
+		std::pmr::vector<Coro<int>> vci5;
+		for (int i = 1; i <= 4; ++i) vci5.emplace_back(coro_int(std::allocator_arg, &g_global_mem, &counter, i));
+		int results5[4] = {};
+		TESTRESULT(++number, "Vector Coro<int> result span", auto rvci5 = co_await collect(vci5, std::span<int>(results5)), rvci5.data() == results5 && results5[0] + results5[1] + results5[2] + results5[3] == 10 && counter.load() == 10, counter = 0);
+
 		//Mixing
 		auto rm1 = co_await parallel( Function{ [&]() { func(&counter); } }, [&]() { func(&counter); }, coro_void(std::allocator_arg, &g_global_mem, &counter), coro_int(std::allocator_arg, &g_global_mem, &counter));
 		TESTRESULT(++number, "Mix Single", , rm1 == 1 && counter.load() == 4, counter = 0);
@@ -267,6 +499,62 @@ namespace test {
 		auto [rf14, rf15] = co_await parallel(cc1.coro_float(1.5f), cff2);
 		TESTRESULT(++number, "Class Yield 8", , rf14 == 1.5f && rf15 == 10.5f && cc1.counter.load() == 9, cc1.counter = 0);
 
+		//data parallel loops
+		TESTRESULT(++number, "parallel_for", co_await parallel_for(range_t{ 0, 1000 }, 10, [&](int i) { counter++; }), counter.load() == 1000, counter = 0);
+		TESTRESULT(++number, "parallel_reduce", auto rpr = co_await parallel_reduce(range_t{ 0, 1000 }, 0, [](range_t<int> r, int acc) { for (int i = r.m_begin; i < r.m_end; ++i) acc += i; return acc; }, [](int a, int b) { return a + b; }, 10), rpr == 499500, );
+
+		TaskGraph graph;
+		std::atomic<int> order = 0;
+		auto a = graph.add_node([&]() { order = 1; });
+		auto b = graph.add_node([&]() { if (order >= 1) counter++; });
+		auto c = graph.add_node([&]() { if (order >= 1) counter++; schedule([&]() { counter++; }); });
+		auto d = graph.add_node([&]() { if (counter.load() == 3) order = 2; });
+		graph.add_edge(a, b); graph.add_edge(a, c); graph.add_edge(b, d); graph.add_edge(c, d);
+		TESTRESULT(++number, "TaskGraph", co_await graph.run(), order.load() == 2, counter = 0; order = 0);
+		TESTRESULT(++number, "TaskGraph replay", co_await graph.run(), order.load() == 2, counter = 0);
+
+		TaskGraph coro_graph;
+		auto e = coro_graph.add_node([&]() { schedule(coro_void(std::allocator_arg, &g_global_mem, &counter, 3)); });	//the node waits for the coro
+		auto f = coro_graph.add_node([&]() { if (counter.load() == 3) order = 3; });
+		coro_graph.add_edge(e, f);
+		TESTRESULT(++number, "TaskGraph node schedules Coro", co_await coro_graph.run(), order.load() == 3, counter = 0; order = 0);
+
+		auto prio_bg = Function{ [&]() { counter++; }, thread_index_t{}, thread_type_t{}, thread_id_t{}, priority_background };
+		auto prio_hi = Function{ [&]() { counter++; }, thread_index_t{}, thread_type_t{}, thread_id_t{}, priority_high };
+		TESTRESULT(++number, "Priorities", co_await parallel(prio_bg, prio_hi, coro_void(std::allocator_arg, &g_global_mem, &counter)(thread_index_t{}, thread_type_t{}, thread_id_t{}, priority_background)), counter.load() == 3, counter = 0);
+
+		TESTRESULT(++number, "run_until in a Function", co_await Function{ [&]() { run_until(Function{ [&]() { func(&counter, 10); } }); counter++; } }, counter.load() == 11, counter = 0);
+
+		cancel_token_t token;
+		auto cancel_func = Function{ [&]() { func(&counter, 5); }, thread_index_t{}, thread_type_t{}, thread_id_t{}, priority_t{}, &token };
+		TESTRESULT(++number, "Cancel token 1", co_await cancel_func, counter.load() == 5, counter = 0);
+		TESTRESULT(++number, "Cancel token 2", auto rc1 = co_await coro_cancel(std::allocator_arg, &g_global_mem, &counter)(&token), rc1 == 1 && counter.load() == 1, counter = 0);
+		token.cancel();
+		TESTRESULT(++number, "Cancelled Function", co_await cancel_func, counter.load() == 0, );
+		TESTRESULT(++number, "Cancelled Coro", auto rc2 = co_await coro_cancel(std::allocator_arg, &g_global_mem, &counter)(thread_index_t{}, thread_type_t{}, thread_id_t{}, priority_t{}, &token), rc2 == -1 && counter.load() == 0, counter = 0);
+
+		auto jobs_executed = []() { uint64_t n = 0; for (auto& t : get_metrics().m_threads) n += t.m_jobs; return n; };
+		auto jobs_before = jobs_executed();
+		TESTRESULT(++number, "Metrics", co_await parallel_for(range_t{ 0, 100 }, 1, [&](int i) { counter++; }), (jobs_executed() > jobs_before || !policy_t::c_enable_metrics) && counter.load() == 100, counter = 0);
+
+		auto frame_sum = [&]() { std::pmr::vector<int> v(frame_resource()); for (int i = 0; i < 100; ++i) v.push_back(i); if (std::accumulate(v.begin(), v.end(), 0) == 4950) counter++; };
+		TESTRESULT(++number, "Frame resource", co_await parallel_for(range_t{ 0, 100 }, 1, [&](int i) { frame_sum(); }), counter.load() == 100, counter = 0; next_frame());
+		TESTRESULT(++number, "Async file I/O", auto rio = co_await coro_io(std::allocator_arg, &g_global_mem, &counter), rio == 23 && counter.load() == 1, counter = 0);
+		TESTRESULT(++number, "File pipeline", auto rpl = co_await coro_pipeline(std::allocator_arg, &g_global_mem, &counter), rpl > 1 && counter.load() == rpl, counter = 0);
+		TESTRESULT(++number, "Channel", auto rch = co_await coro_channel(std::allocator_arg, &g_global_mem, &counter), rch == 1 && counter.load() == 3 * 5050, counter = 0);
+		TESTRESULT(++number, "Pipeline", auto rpp = co_await coro_pipeline_stages(std::allocator_arg, &g_global_mem, &counter), rpp == 201 && counter.load() == 100, counter = 0);
+		TESTRESULT(++number, "Placement last child Coro<int>", auto rpc = co_await coro_placement(std::allocator_arg, &g_global_mem, &counter), rpc == 1 && counter.load() == 1, counter = 0);
+		std::atomic<int> placed_thread{ -1 };
+		TESTRESULT(++number, "Placement last child continuation", co_await[&]() { func_placement(&counter, &placed_thread); }, placed_thread.load() == js.get_thread_count().value - 1 && counter.load() == 1, counter = 0);
+		TESTRESULT(++number, "SoA batch", auto rsoa = co_await coro_batch(std::allocator_arg, &g_global_mem, &counter), rsoa == 3000 && counter.load() == 1000, counter = 0);
+		TESTRESULT(++number, "Deferred optional Function", auto rdf = co_await coro_defer(std::allocator_arg, &g_global_mem, &counter), rdf == 0 && counter.load() == 1, counter = 0);
+		TESTRESULT(++number, "Deadline miss report", auto rdm = co_await coro_deadline(std::allocator_arg, &g_global_mem, &counter), (rdm == 1 || !policy_t::c_enable_metrics) && counter.load() == 1, counter = 0);
+		TESTRESULT(++number, "Coro deadline miss counted once", auto rdo = co_await coro_deadline_once(std::allocator_arg, &g_global_mem, &counter), (rdo == 1 || !policy_t::c_enable_metrics) && counter.load() == 3, counter = 0);
+		TESTRESULT(++number, "Second CoroFrameResource", auto rcf = co_await coro_int(std::allocator_arg, &g_frame_mem, &counter, 10), rcf == 10 && frame_resource_blocks() == 1, counter = 0);
+		TESTRESULT(++number, "Remote jobs", auto rrj = co_await coro_remote(std::allocator_arg, &g_global_mem, &counter), rrj == 2 * 4950 && counter.load() == 100, counter = 0);
+		TESTRESULT(++number, "Remote frame limits", auto rrf = co_await coro_remote_frames(std::allocator_arg, &g_global_mem, &counter), rrf == 50 && counter.load() == 52, counter = 0);
+		TESTRESULT(++number, "Frame resource Coro<int>", auto rfr = co_await coro_int(std::allocator_arg, frame_resource(), &counter, 10), rfr == 10 && counter.load() == 10, counter = 0; next_frame());
+
 		//changing threads
 
 		co_await thread_index_t{0};
@@ -296,6 +584,10 @@ namespace test {
 		TESTRESULT(++number, "Tagged jobs 1", co_await tag_t{ 1 }, counter.load() == 2, );
 		TESTRESULT(++number, "Tagged jobs 2", co_await tag_t{ 2 }, counter.load() == 4, );
 		TESTRESULT(++number, "Tagged jobs 3", co_await tag_t{ 3 }, counter.load() == 10, counter = 0);
+
+		co_await parallel_for(range_t{ 0, 300 }, 1, [&](int i) { schedule([&]() { func(&counter); }, tag_t{ i % 2 == 0 ? 4 : 100000 + i % 3 }); });
+
+		TESTRESULT(++number, "Tagged jobs from many threads", co_await tag_t{ 4 }; co_await tag_t{ 100000 }; co_await tag_t{ 100001 }; co_await tag_t{ 100002 }, counter.load() == 300, counter = 0);
 		
 		vgjs::terminate();
 
@@ -312,8 +604,19 @@ int main(int argc, char* argv[])
 	int num = argc > 1 ? std::stoi(argv[1]) : 0;
 	JobSystem js(thread_count_t{ num });
 
+	std::atomic<int> counter = 0;	//main is not a worker thread, so it can block until jobs are done
+	TESTRESULT(0, "schedule_and_wait", int sw = schedule_and_wait(test::coro_int(std::allocator_arg, &test::g_global_mem, &counter, 3)), sw == 3 && counter.load() == 3, counter = 0);
+	TESTRESULT(0, "schedule_and_wait Function", schedule_and_wait(Function{ [&]() { test::func(&counter, 5); } }), counter.load() == 5, counter = 0);
+	TESTRESULT(0, "run_until", bool ru = run_until(Function{ [&]() { test::func(&counter, 5); } }), ru && counter.load() == 5, );
+
 	schedule(test::start_test());
 
+	wait_for_termination();
+	TESTRESULT(0, "No restart by accessor", JobSystem late, late.get_thread_count().value == 0, );	//no threads are started again
+
+	JobSystem js2(thread_count_t{ 2 });	//restart with a different number of threads
+	TESTRESULT(0, "Restart", int rs = schedule_and_wait(test::coro_int(std::allocator_arg, &test::g_global_mem, &counter, 3)), rs == 3 && js2.get_thread_count().value == 2, );
+	terminate();
 	wait_for_termination();
 	std::cerr << "Press Any Key + Return to Exit\n";
 	std::string str;
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <string>
+
+
+#include "VGJS.h"
+
+
+/**
+* \brief Convert a binary trace file written by vgjs::dump_trace() into a Chrome trace JSON file.
+*
+* Usage: traceconv trace.bin [log.json]
+*/
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " <trace.bin> [<log.json>]\n";
+		return 1;
+	}
+	std::string out = argc > 2 ? argv[2] : "log.json";
+	if (!vgjs::convert_trace(argv[1], out)) {
+		std::cout << "Could not convert " << argv[1] << "\n";
+		return 1;
+	}
+	std::cout << "Wrote " << out << "\n";
+	return 0;
+}
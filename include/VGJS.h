@@ -35,6 +35,20 @@
 #include <sstream>
 #include <compare>
 #include <unordered_map>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <tuple>
+#include <cctype>
+#include <cstdio>
+#include <cmath>
+#include <bit>
+#include <concepts>
+#include <array>
+#include <span>
+#include <numeric>
+#include <limits>
 
 using namespace std::chrono;
 
@@ -57,11 +71,36 @@ using namespace std::chrono;
 #else
 #endif
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#elif defined(_M_ARM64) || defined(_M_ARM)
+    #include <intrin.h>
+#endif
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <winsock2.h>       //before windows.h, which would pull in the old winsock.h
+    #include <ws2tcpip.h>
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <filesystem>
+#endif
+
 
 namespace vgjs {
 
     class Job;
     class Job_base;
+    class JobPool;
     class JobSystem;
 
     template<typename T, typename P, auto D = -1>
@@ -101,13 +140,112 @@ namespace vgjs {
     using thread_count_t = int_type<int, struct P3, -1>;
     using tag_t = int_type<int, struct P4, -1>;
     using parent_t = int_type<int, struct P5, -1>;
+    using priority_t = int_type<int, struct P6, 1>;
+    using placement_t = int_type<int, struct P7, -1>;
+
+    inline const priority_t priority_high{ 0 };         ///<frame critical jobs, always run first
+    inline const priority_t priority_normal{ 1 };       ///<default priority
+    inline const priority_t priority_background{ 2 };   ///<e.g. streaming, runs if nothing else is there, but does not starve
+
+    inline const placement_t placement_any{ -1 };        ///<default, the scheduler decides where a continuation or parent runs
+    inline const placement_t placement_last_child{ -2 }; ///<run on the thread that finished the last child, its caches are hot
+                                                         ///<values >= 0 are a hint for the thread that should run the job
+
+    /**
+    * \brief Time budget of a job in the current frame, see JobSystem::set_frame_budget().
+    */
+    struct budget_t {
+        std::chrono::microseconds   m_deadline{ -1 };   ///<deadline relative to the start of the frame the job is scheduled in, negative for none
+        bool                        m_optional = false; ///<a Function that may be deferred to the next frame if the frame budget is nearly spent
+    };
+
+    /**
+    * \brief The frame the scheduler plans for, see JobSystem::set_frame_budget().
+    */
+    struct frame_budget_t {
+        std::chrono::microseconds   m_budget{ 0 };      ///<length of a frame, 0 for no frame budget
+        std::chrono::microseconds   m_reserve{ 1000 };  ///<optional jobs are deferred if less than this is left of the frame
+        tag_t                       m_defer_tag{};      ///<tag that deferred jobs are put into, schedule it in the next frame
+    };
 
     bool is_logging();
-    void log_data(  std::chrono::high_resolution_clock::time_point& t1
-                    , std::chrono::high_resolution_clock::time_point& t2
-                    , thread_index_t exec_thread, bool finished, thread_type_t type, thread_id_t id);
     void save_log_file();
 
+    /**
+    * \brief Tell the CPU that this is a spin loop, so the other hyperthread can use the core.
+    */
+    inline void cpu_pause() noexcept {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(_M_ARM64) || defined(_M_ARM)
+        __yield();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield");
+#endif
+    }
+
+    /**
+    * \brief What a thread does when it does not find any work.
+    *
+    * A thread first spins m_spin times, then gives up its time slice m_yield times, and finally
+    * parks on its condition variable until work arrives for it, or m_park has passed.
+    */
+    struct idle_policy_t {
+        uint32_t                    m_spin = 1 << 6;                        ///<number of empty loops spinning with pause
+        uint32_t                    m_yield = 1 << 4;                       ///<number of empty loops calling yield
+        std::chrono::microseconds   m_park = std::chrono::microseconds(1000); ///<max time a parked thread sleeps
+    };
+
+    /**
+    * \brief Spin lock used by the job queues, an alternative is std::mutex.
+    */
+    struct spin_lock_t {
+        std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+
+        void lock() noexcept { while (m_flag.test_and_set(std::memory_order::acquire)); }
+        void unlock() noexcept { m_flag.clear(std::memory_order::release); }
+    };
+
+    /**
+    * \brief Compile time configuration of the job system.
+    *
+    * To use another configuration, define VGJS_POLICY as the name of a struct before including VGJS.h.
+    * The struct only needs the members that differ from this default, e.g. a release build
+    * can strip all instrumentation with:
+    *
+    *     struct my_policy { static constexpr bool c_enable_logging = false; static constexpr bool c_enable_metrics = false; };
+    *     #define VGJS_POLICY ::my_policy
+    */
+    struct default_policy_t {
+        static constexpr bool           c_enable_logging = true;    ///<false removes trace recording from the hot path
+        static constexpr bool           c_enable_metrics = true;    ///<false removes the runtime counters, get_metrics() then returns zeros
+        static constexpr bool           c_spin_lock_queues = true;  ///<job queues use a spin lock, false uses std::mutex, e.g. for oversubscribed systems
+        static constexpr std::size_t    c_job_storage = 56;         ///<bytes of inline storage for the callable of a job
+        static constexpr idle_policy_t  c_idle_policy{};            ///<idle strategy the system starts with
+        static constexpr uint32_t       c_combine_size = 64;        ///<children of large batches report to their parent in groups of this size, 0 turns it off
+    };
+
+#ifndef VGJS_POLICY
+    #define VGJS_POLICY vgjs::default_policy_t
+#endif
+
+    /**
+    * \brief The configuration in use, members missing in VGJS_POLICY are taken from default_policy_t.
+    */
+    template<typename P>
+    struct policy_traits_t {
+        static constexpr bool c_enable_logging = [] { if constexpr (requires { P::c_enable_logging; }) return (bool)P::c_enable_logging; else return default_policy_t::c_enable_logging; }();
+        static constexpr bool c_enable_metrics = [] { if constexpr (requires { P::c_enable_metrics; }) return (bool)P::c_enable_metrics; else return default_policy_t::c_enable_metrics; }();
+        static constexpr bool c_spin_lock_queues = [] { if constexpr (requires { P::c_spin_lock_queues; }) return (bool)P::c_spin_lock_queues; else return default_policy_t::c_spin_lock_queues; }();
+        static constexpr std::size_t c_job_storage = [] { if constexpr (requires { P::c_job_storage; }) return (std::size_t)P::c_job_storage; else return default_policy_t::c_job_storage; }();
+        static constexpr idle_policy_t c_idle_policy = [] { if constexpr (requires { P::c_idle_policy; }) return (idle_policy_t)P::c_idle_policy; else return default_policy_t::c_idle_policy; }();
+        static constexpr uint32_t c_combine_size = [] { if constexpr (requires { P::c_combine_size; }) return (uint32_t)P::c_combine_size; else return default_policy_t::c_combine_size; }();
+
+        using queue_lock_t = std::conditional_t<c_spin_lock_queues, spin_lock_t, std::mutex>;
+    };
+
+    using policy_t = policy_traits_t<VGJS_POLICY>;
+
     //---------------------------------------------------------------------------------------------------
 
     //test whether a template parameter T is a std::pmr::vector
@@ -120,25 +258,198 @@ namespace vgjs {
     //---------------------------------------------------------------------------------------------------
 
     /**
-    * \brief Function struct wraps a c++ function of type std::function<void(void)>.
-    * 
+    * \brief Type erased callable void(void) with inline storage.
+    *
+    * Unlike std::function, callables up to N bytes are stored inside the object itself, so typical
+    * lambdas do not allocate any heap memory. Larger callables (or callables that might throw
+    * when being moved) are allocated on the heap as a fallback. Like with std::function, the
+    * callable must be copyable, this is checked at compile time.
+    */
+    template<std::size_t N = 56>
+    class InlineFunction {
+        template<std::size_t M> friend class InlineFunction;
+
+        struct ops_t {
+            void (*m_invoke)(void*);                            ///<call the callable
+            void (*m_move)(void* dst, void* src) noexcept;      ///<move construct into dst and destroy src
+            void (*m_copy)(void* dst, const void* src);         ///<copy construct into dst
+            void (*m_destroy)(void*) noexcept;                  ///<destroy the callable
+        };
+
+        template<typename F>
+        static constexpr bool is_inline = sizeof(F) <= N && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+        template<typename F>
+        static F* target(void* p) noexcept {
+            if constexpr (is_inline<F>) return std::launder(reinterpret_cast<F*>(p));
+            else return *reinterpret_cast<F**>(p);
+        }
+
+        template<typename F>
+        static void copy_construct(void* dst, const void* src) {
+            const F& f = *target<F>(const_cast<void*>(src));
+            if constexpr (is_inline<F>) new (dst) F(f);
+            else *reinterpret_cast<F**>(dst) = new F(f);
+        }
+
+        template<typename F>
+        static inline const ops_t c_ops = {
+            [](void* p) { (*target<F>(p))(); },
+            [](void* dst, void* src) noexcept {
+                if constexpr (is_inline<F>) { new (dst) F(std::move(*target<F>(src))); target<F>(src)->~F(); }
+                else *reinterpret_cast<F**>(dst) = *reinterpret_cast<F**>(src);
+            },
+            &copy_construct<F>,
+            [](void* p) noexcept {
+                if constexpr (is_inline<F>) target<F>(p)->~F();
+                else delete target<F>(p);
+            }
+        };
+
+        alignas(std::max_align_t) std::byte m_storage[N];   ///<inline storage for the callable
+        const ops_t* m_ops = nullptr;                       ///<operations of the stored type, nullptr if empty
+
+        template<typename F>
+        void construct(F&& f) {
+            using FT = std::decay_t<F>;
+            using FR = std::remove_cvref_t<F>;              //unlike FT, a function name does not decay here, it is never null
+            if constexpr (std::is_pointer_v<FR> || std::is_same_v<FR, std::function<void(void)>>) {
+                if (!f) return;                             //stay empty
+            }
+            if constexpr (is_inline<FT>) new (m_storage) FT(std::forward<F>(f));
+            else *reinterpret_cast<FT**>(m_storage) = new FT(std::forward<F>(f));
+            m_ops = &c_ops<FT>;
+        }
+
+        void copy_from(const InlineFunction& other) {
+            if (other.m_ops == nullptr) return;
+            other.m_ops->m_copy(m_storage, other.m_storage);
+            m_ops = other.m_ops;
+        }
+
+        void move_from(InlineFunction& other) noexcept {
+            if (other.m_ops == nullptr) return;
+            other.m_ops->m_move(m_storage, other.m_storage);
+            m_ops = std::exchange(other.m_ops, nullptr);
+        }
+
+    public:
+        InlineFunction() noexcept {};
+        InlineFunction(std::nullptr_t) noexcept {};
+
+        template<typename F>
+        requires (!std::is_same_v<std::decay_t<F>, InlineFunction> && std::is_invocable_v<std::decay_t<F>&> && std::is_copy_constructible_v<std::decay_t<F>>)
+        InlineFunction(F&& f) { construct(std::forward<F>(f)); };
+
+        InlineFunction(const InlineFunction& other) { copy_from(other); };
+        InlineFunction(InlineFunction&& other) noexcept { move_from(other); };
+
+        InlineFunction& operator= (const InlineFunction& other) {
+            if (this != &other) { reset(); copy_from(other); }
+            return *this;
+        }
+
+        InlineFunction& operator= (InlineFunction&& other) noexcept {
+            if (this != &other) { reset(); move_from(other); }
+            return *this;
+        }
+
+        template<typename F>
+        requires (!std::is_same_v<std::decay_t<F>, InlineFunction> && std::is_invocable_v<std::decay_t<F>&> && std::is_copy_constructible_v<std::decay_t<F>>)
+        InlineFunction& operator= (F&& f) {
+            reset();
+            construct(std::forward<F>(f));
+            return *this;
+        }
+
+        InlineFunction& operator= (std::nullptr_t) noexcept { reset(); return *this; }
+
+        ~InlineFunction() { reset(); }
+
+        /**
+        * \brief Destroy the stored callable.
+        */
+        void reset() noexcept {
+            if (m_ops != nullptr) {
+                m_ops->m_destroy(m_storage);
+                m_ops = nullptr;
+            }
+        }
+
+        explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+        void operator() () { m_ops->m_invoke(m_storage); }
+    };
+
+    using job_function_t = InlineFunction<policy_t::c_job_storage>;
+
+
+    /**
+    * \brief A token for cancelling a job together with all its descendants.
+    *
+    * A job scheduled without a token inherits the token of its parent. Functions with a cancelled
+    * token are skipped instead of run, coros check the token themselves with co_await cancel_check_t{}.
+    * The token must live until all jobs using it have finished.
+    */
+    class cancel_token_t {
+        std::atomic<bool> m_cancelled = false;  ///<if true then the jobs should not run anymore
+
+    public:
+        cancel_token_t() noexcept = default;
+        cancel_token_t(const cancel_token_t&) = delete;
+
+        void cancel() noexcept { m_cancelled.store(true, std::memory_order::relaxed); }             ///<cancel all jobs using this token
+        void reset() noexcept { m_cancelled.store(false, std::memory_order::relaxed); }             ///<reuse the token
+        bool cancelled() const noexcept { return m_cancelled.load(std::memory_order::relaxed); }  ///<test whether jobs should stop
+    };
+
+    /**
+    * \brief Awaited by coros to test whether their cancel token has been cancelled.
+    */
+    struct cancel_check_t {};
+
+    /**
+    * \brief Optional parameters of a Function or a Coro. Since each has its own type, they can be given in any order.
+    */
+    template<typename T>
+    concept JOB_OPTION = std::is_same_v<std::decay_t<T>, thread_index_t> || std::is_same_v<std::decay_t<T>, thread_type_t>
+        || std::is_same_v<std::decay_t<T>, thread_id_t> || std::is_same_v<std::decay_t<T>, priority_t>
+        || std::is_same_v<std::decay_t<T>, placement_t> || std::is_same_v<std::decay_t<T>, budget_t>
+        || std::is_convertible_v<T, cancel_token_t*>;
+
+    /**
+    * \brief Function struct wraps a c++ function of type void(void).
+    *
+    * The function is stored in an InlineFunction, so lambdas with typical captures
+    * do not cause heap allocations.
     * It can hold a function, and additionally a thread index where the function should
     * be executed, a type and an id for dumping a trace file to be shown by
-    * Google Chrome about::tracing.
+    * Google Chrome about::tracing, a priority, a cancel token, a placement and a budget.
+    * These options follow the function in any order, e.g. Function{ f, priority_high, thread_index_t{ 0 } }.
     */
     struct Function {
-        std::function<void(void)>   m_function = []() {};  //empty function
+        job_function_t              m_function = []() {};  //empty function
         thread_index_t              m_thread_index;        //thread that the f should run on
         thread_type_t               m_type;                //type of the call
         thread_id_t                 m_id;                  //unique identifier of the call
+        priority_t                  m_priority;            //priority of the call
+        cancel_token_t*             m_token = nullptr;     //cancel token, if nullptr then the token of the parent is used
+        placement_t                 m_placement;           //where the job runs if it is a continuation
+        budget_t                    m_budget;              //deadline and whether the job can be deferred
+
+        template<typename F, typename... Ts>
+        requires (!std::is_same_v<std::decay_t<F>, Function> && std::is_convertible_v<std::decay_t<F>, std::function<void(void)>> && (JOB_OPTION<Ts> && ...))
+        Function(F&& f, Ts&&... options) : m_function(std::forward<F>(f)) {
+            (set_option(std::forward<Ts>(options)), ...);
+        };
 
-        Function(std::function<void(void)>& f, thread_index_t index = thread_index_t{}, 
-            thread_type_t type = thread_type_t{}, thread_id_t id = thread_id_t{})
-            : m_function(f), m_thread_index(index), m_type(type), m_id(id) {};
-
-        Function(std::function<void(void)>&& f, thread_index_t index = thread_index_t{}, 
-            thread_type_t type = thread_type_t{}, thread_id_t id = thread_id_t{})
-            : m_function(std::move(f)), m_thread_index(index), m_type(type), m_id(id) {};
+        void set_option(thread_index_t index) noexcept { m_thread_index = index; }
+        void set_option(thread_type_t type) noexcept { m_type = type; }
+        void set_option(thread_id_t id) noexcept { m_id = id; }
+        void set_option(priority_t priority) noexcept { m_priority = priority; }
+        void set_option(cancel_token_t* token) noexcept { m_token = token; }
+        void set_option(placement_t placement) noexcept { m_placement = placement; }
+        void set_option(budget_t budget) noexcept { m_budget = budget; }
 
         Function(const Function& f) = default;
         Function(Function&& f) = default;
@@ -187,16 +498,28 @@ namespace vgjs {
         thread_index_t      m_thread_index;     //thread that the job should run on and ran on
         thread_type_t       m_type;             //for logging performance
         thread_id_t         m_id;               //for logging performance
+        priority_t          m_priority;         //queues with higher priority are served first
+        cancel_token_t*     m_token;            //jobs with a cancelled token are skipped
+        placement_t         m_placement;        //where the job runs when it is continued after its children
+        uint64_t            m_deadline;         //in ns of trace_nanoseconds(), jobs with earlier deadlines run first
+        bool                m_optional;         //a Function that may be deferred to the next frame
         bool                m_is_function;      //default - this is not a function
+        bool                m_is_coro;          //true only for coro promises, other jobs like graph nodes are not resumed as coros
+
+        static inline const uint64_t c_no_deadline = std::numeric_limits<uint64_t>::max();
+
+        Job_base() : m_children{ 0 }, m_parent{ nullptr }, m_thread_index{}, m_type{}, m_id{}, m_priority{}, m_token{ nullptr }, m_placement{}
+            , m_deadline{ c_no_deadline }, m_optional{ false }, m_is_function{ false }, m_is_coro{ false } {}
 
-        Job_base() : m_children{ 0 }, m_parent{ nullptr }, m_thread_index{}, m_type{}, m_id{}, m_is_function{ false } {}
+        bool has_deadline() const noexcept { return m_deadline != c_no_deadline; }
 
         virtual bool resume() = 0;                      //this is the actual work to be done
         void operator() () noexcept {           //wrapper as function operator
             resume();
         }
         bool is_function() noexcept { return m_is_function; }         //test whether this is a function or e.g. a coro
-        virtual job_deallocator get_deallocator() noexcept { return job_deallocator{}; };    //called for deallocation
+        bool is_coro() noexcept { return m_is_coro; }                 //test whether this is a coro promise
+        virtual job_deallocator& get_deallocator() noexcept { static job_deallocator deallocator; return deallocator; };    //called for deallocation
     };
 
 
@@ -206,11 +529,13 @@ namespace vgjs {
     class Job : public Job_base {
     public:
         n_pmr::memory_resource*     m_mr = nullptr;  //memory resource that was used to allocate this Job
+        JobPool*                    m_pool = nullptr;   //pool this Job belongs to
         Job_base*                   m_continuation = nullptr;   //continuation follows this job (a coro is its own continuation)
-        std::function<void(void)>   m_function;      //function to compute
+        uint32_t                    m_combined = 0;  //if > 0 this Job only counts this many children of its parent, see allocate_combiner()
+        job_function_t              m_function;      //function to compute, stored inline
         pfvoid                      m_pfvoid=nullptr;
 
-        Job( n_pmr::memory_resource* pmr) : Job_base(), m_mr(pmr), m_continuation(nullptr) {
+        Job( n_pmr::memory_resource* pmr, JobPool* pool = nullptr) : Job_base(), m_mr(pmr), m_pool(pool), m_continuation(nullptr) {
             m_children = 1;
             m_is_function = true;
         }
@@ -220,9 +545,15 @@ namespace vgjs {
             m_children = 1;
             m_parent = nullptr;
             m_continuation = nullptr;
+            m_combined = 0;
             m_thread_index = thread_index_t{};
             m_type = thread_type_t{};
             m_id = thread_id_t{};
+            m_priority = priority_t{};
+            m_token = nullptr;
+            m_placement = placement_t{};
+            m_deadline = c_no_deadline;
+            m_optional = false;
         }
 
         bool resume() noexcept {    //work is to call the function
@@ -237,45 +568,360 @@ namespace vgjs {
 
 
     /**
-    * \brief Deallocate a Job instance.
-    * \param[in] job Pointer to the job.
+    * \brief Pool of Job structures, each thread owns one pool.
+    *
+    * Jobs are allocated in slabs from the memory resource, and are only given back when the
+    * job system shuts down. The owner allocates and frees Jobs through a plain free list.
+    * Other threads return Jobs through a lock-free stack, which the owner takes as a whole
+    * when its free list runs empty. The pool for threads outside the job system is shared,
+    * so allocating from it takes a lock.
     */
-    inline void job_deallocator::deallocate(Job_base* job) noexcept {
-        n_pmr::polymorphic_allocator<Job> allocator(((Job*)job)->m_mr); //construct a polymorphic allocator
-        ((Job*)job)->~Job();                                          //call destructor
-        allocator.deallocate(((Job*)job), 1);                         //use pma to deallocate the memory
-    }
+    class JobPool {
+        static inline const uint32_t c_slab_size = 1 << 6;     ///<number of Jobs allocated at once
+
+        n_pmr::memory_resource*     m_mr;                       ///<memory resource for allocating slabs
+        bool                        m_shared;                   ///<if true then many threads allocate from this pool
+        std::atomic_flag            m_lock = ATOMIC_FLAG_INIT;  ///<lock for shared pools
+        Job*                        m_free = nullptr;           ///<free list, used only by the owner
+        std::atomic<uint64_t>       m_hits = 0;                 ///<allocations served by free Jobs
+        std::atomic<uint64_t>       m_misses = 0;               ///<allocations that needed a new slab
+        alignas(64) std::atomic<Job*> m_remote = nullptr;       ///<Jobs returned by other threads
+        std::vector<Job*>           m_slabs;                    ///<all slabs allocated so far
+
+        /**
+        * \brief Allocate a new slab from the memory resource and put its Jobs into the free list.
+        */
+        void allocate_slab() {
+            n_pmr::polymorphic_allocator<Job> allocator(m_mr);   //use this allocator
+            Job* slab = allocator.allocate(c_slab_size);         //allocate the objects
+            if (slab == nullptr) {
+                std::cout << "No job available\n";
+                std::terminate();
+            }
+            for (uint32_t i = 0; i < c_slab_size; ++i) {
+                new (&slab[i]) Job(m_mr, this);                  //call constructor
+                slab[i].m_next = m_free;
+                m_free = &slab[i];
+            }
+            m_slabs.push_back(slab);
+        }
+
+    public:
+
+        JobPool(n_pmr::memory_resource* mr, bool shared = false) noexcept : m_mr(mr), m_shared(shared) {};
+        JobPool(const JobPool&) = delete;
+        ~JobPool() { release(); }
+
+        /**
+        * \brief Make sure that at least num Jobs have been allocated. Call only from the owner.
+        * \param[in] num Number of Jobs to reserve.
+        */
+        void reserve(uint32_t num) {
+            while (m_slabs.size() * c_slab_size < num) allocate_slab();
+        }
+
+        /**
+        * \brief Allocate a Job from the pool. Call only from the owner, or any thread for shared pools.
+        * \returns a pointer to the Job.
+        */
+        Job* allocate() {
+            if (m_shared) {
+                while (m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+            }
+            if (m_free == nullptr) {
+                m_free = m_remote.exchange(nullptr, std::memory_order::acquire);  //take all returned Jobs
+            }
+            if (m_free == nullptr) {
+                allocate_slab();
+                m_misses.store(m_misses.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+            }
+            else {
+                m_hits.store(m_hits.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+            }
+            Job* job = m_free;
+            m_free = (Job*)job->m_next;
+            if (m_shared) {
+                m_lock.clear(std::memory_order::release);     //release lock
+            }
+            return job;
+        }
+
+        /**
+        * \brief The owner returns a Job to the pool.
+        * \param[in] job The Job to return.
+        */
+        void free(Job* job) noexcept {
+            job->m_next = m_free;
+            m_free = job;
+        }
+
+        /**
+        * \brief Any thread returns a Job to the pool.
+        * \param[in] job The Job to return.
+        */
+        void free_remote(Job* job) noexcept {
+            Job* head = m_remote.load(std::memory_order::relaxed);
+            do {
+                job->m_next = head;
+            } while (!m_remote.compare_exchange_weak(head, job, std::memory_order::release, std::memory_order::relaxed));
+        }
+
+        /**
+        * \brief Destroy all Jobs and give the slabs back to the memory resource.
+        */
+        void release() noexcept {
+            n_pmr::polymorphic_allocator<Job> allocator(m_mr);
+            for (Job* slab : m_slabs) {
+                for (uint32_t i = 0; i < c_slab_size; ++i) slab[i].~Job();  //call destructor
+                allocator.deallocate(slab, c_slab_size);                    //use pma to deallocate the memory
+            }
+            m_slabs.clear();
+            m_free = nullptr;
+            m_remote = nullptr;
+        }
+
+        uint64_t hits() const noexcept { return m_hits.load(std::memory_order::relaxed); }       ///<allocations served by free Jobs
+        uint64_t misses() const noexcept { return m_misses.load(std::memory_order::relaxed); }   ///<allocations that needed a new slab
+    };
 
 
     /**
-    * \brief Data structure storing times when jobs where called and ended.
-    * Can be saved to a log file and loaded into Google Chrom about:://tracing.
+    * \brief Bump allocator for memory that only lives for one frame, each thread owns its own arenas.
+    *
+    * Memory is cut from chunks that are taken from the upstream resource. Single allocations are
+    * never freed, instead the whole arena is reset when its frame is reused. Chunks are kept
+    * across resets, so after a few frames an arena does not allocate from upstream anymore.
     */
-    struct JobLog {
-        std::chrono::high_resolution_clock::time_point m_t1, m_t2;	///< execution start and end
-        thread_index_t  m_exec_thread;
-        bool			m_finished;
-        thread_type_t   m_type;
-        thread_id_t     m_id;
+    class FrameArena {
+        static inline const std::size_t c_chunk_size = 1 << 16;    ///<minimum size of a chunk in bytes
 
-        JobLog(std::chrono::high_resolution_clock::time_point& t1, std::chrono::high_resolution_clock::time_point& t2,
-            thread_index_t exec_thread, bool finished, thread_type_t type, thread_id_t id)
-                : m_t1(t1), m_t2(t2), m_exec_thread(exec_thread), m_finished(finished), m_type(type), m_id(id) {
+        struct alignas(std::max_align_t) chunk_t {
+            chunk_t*    m_next = nullptr;
+            std::size_t m_size = 0;         ///<usable bytes behind the header
         };
+
+        n_pmr::memory_resource* m_upstream;             ///<memory resource for allocating chunks
+        chunk_t*                m_head = nullptr;       ///<first chunk
+        chunk_t*                m_chunk = nullptr;      ///<chunk that is currently cut
+        std::size_t             m_offset = 0;           ///<bytes used in the current chunk
+        uint64_t                m_frame = 0;            ///<frame the arena currently belongs to
+
+        /**
+        * \brief Append a new chunk behind the current chunk.
+        * \param[in] min_size The chunk must have at least this many usable bytes.
+        */
+        void add_chunk(std::size_t min_size) {
+            std::size_t size = std::max(c_chunk_size, min_size);
+            void* p = m_upstream->allocate(sizeof(chunk_t) + size, alignof(chunk_t));
+            chunk_t* chunk = new (p) chunk_t{ nullptr, size };
+            if (m_chunk == nullptr) m_head = chunk;
+            else m_chunk->m_next = chunk;
+            m_chunk = chunk;
+            m_offset = 0;
+        }
+
+    public:
+
+        FrameArena(n_pmr::memory_resource* upstream) noexcept : m_upstream(upstream) {};
+        FrameArena(const FrameArena&) = delete;
+        ~FrameArena() { release(); }
+
+        /**
+        * \brief Allocate memory from the arena.
+        * \param[in] bytes Number of bytes.
+        * \param[in] alignment Alignment of the memory, must be a power of 2.
+        * \returns a pointer to the memory.
+        */
+        void* allocate(std::size_t bytes, std::size_t alignment) {
+            while (true) {
+                if (m_chunk != nullptr) {
+                    std::uintptr_t base = (std::uintptr_t)(m_chunk + 1);
+                    std::uintptr_t p = (base + m_offset + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+                    if (p + bytes <= base + m_chunk->m_size) {
+                        m_offset = p + bytes - base;
+                        return (void*)p;
+                    }
+                    if (m_chunk->m_next != nullptr) {     //reuse chunks of previous frames
+                        m_chunk = m_chunk->m_next;
+                        m_offset = 0;
+                        continue;
+                    }
+                }
+                add_chunk(bytes + alignment);
+            }
+        }
+
+        /**
+        * \brief Forget all allocations, the chunks are kept for the next frame.
+        * \param[in] frame The frame the arena belongs to from now on.
+        */
+        void reset(uint64_t frame) noexcept {
+            m_chunk = m_head;
+            m_offset = 0;
+            m_frame = frame;
+        }
+
+        /**
+        * \brief Give all chunks back to the upstream resource.
+        */
+        void release() noexcept {
+            while (m_head != nullptr) {
+                chunk_t* chunk = m_head;
+                m_head = chunk->m_next;
+                m_upstream->deallocate(chunk, sizeof(chunk_t) + chunk->m_size, alignof(chunk_t));
+            }
+            m_chunk = nullptr;
+            m_offset = 0;
+        }
+
+        uint64_t frame() const noexcept { return m_frame; }     ///<frame the arena currently belongs to
+    };
+
+
+    /**
+    * \brief Memory resource that allocates from the frame arenas of the job system.
+    *
+    * Each thread allocates from its own arena for the current frame, so no synchronization is needed.
+    * Deallocation does nothing, all memory of a frame is freed at once when the frame is reused.
+    */
+    class FrameResource : public n_pmr::memory_resource {
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;    //see JobSystem::frame_allocate()
+        void do_deallocate(void*, std::size_t, std::size_t) override {}      //freed with the whole frame
+        bool do_is_equal(const n_pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+
+    /**
+    * \brief Read a fast time stamp counter. Uses the CPU time stamp counter on x86, else the steady clock.
+    * \returns the current time in ticks.
+    */
+    inline uint64_t trace_ticks() noexcept {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+    * \brief Get the current time in nanoseconds, used to calibrate ticks.
+    * \returns nanoseconds of the steady clock.
+    */
+    inline uint64_t trace_nanoseconds() noexcept {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+    * \brief A job run recorded in a trace buffer. Times are in ticks of trace_ticks().
+    */
+    struct trace_event_t {
+        uint64_t    m_t1;       ///<execution start
+        uint64_t    m_t2;       ///<execution end
+        int32_t     m_type;     ///<type of the job
+        int32_t     m_id;       ///<id of the job
+    };
+
+    /**
+    * \brief Header of a binary trace file written by dump_trace().
+    *
+    * The header is followed by the type names (number of names, then for each name type, length and
+    * characters), and then for each thread its index, its number of events and the events.
+    */
+    struct trace_header_t {
+        char        m_magic[8] = { 'V','G','J','S','T','R','C','\0' };
+        uint32_t    m_version = 1;
+        uint32_t    m_num_threads = 0;
+        double      m_ns_per_tick = 1.0;    ///<to convert ticks to nanoseconds
+        uint64_t    m_start_ticks = 0;      ///<ticks when the job system was started
+    };
+
+    /**
+    * \brief Fixed size ring buffer of trace events for one thread.
+    *
+    * Only the owner thread writes into the buffer, so recording is just a store and a counter increment.
+    * The buffer is overwritten continuously, so it always holds the last c_capacity events. Other threads
+    * can take a snapshot at any time; events that were overwritten while copying are dropped.
+    */
+    class TraceBuffer {
+    public:
+        static inline const uint64_t c_capacity = 1 << 16;     ///<number of events, must be a power of 2
+
+    private:
+        std::atomic<trace_event_t*>         m_events = nullptr;     ///<allocated by the owner when it records the first event
+        std::unique_ptr<trace_event_t[]>    m_storage;
+        alignas(64) std::atomic<uint64_t>   m_head = 0;             ///<number of events written so far
+        std::atomic<uint64_t>               m_start = 0;            ///<events before this one have been cleared
+
+    public:
+
+        /**
+        * \brief Record an event. Call only from the owner thread.
+        * \param[in] t1 Start ticks.
+        * \param[in] t2 End ticks.
+        * \param[in] type Type of the job.
+        * \param[in] id Id of the job.
+        */
+        void record(uint64_t t1, uint64_t t2, thread_type_t type, thread_id_t id) noexcept {
+            trace_event_t* events = m_events.load(std::memory_order::relaxed);
+            if (events == nullptr) {
+                m_storage = std::make_unique<trace_event_t[]>(c_capacity);
+                events = m_storage.get();
+                m_events.store(events, std::memory_order::release);
+            }
+            uint64_t head = m_head.load(std::memory_order::relaxed);
+            events[head & (c_capacity - 1)] = trace_event_t{ t1, t2, type.value, id.value };
+            m_head.store(head + 1, std::memory_order::release);
+        }
+
+        /**
+        * \brief Copy the events that ended at or after a given time.
+        * \param[in] since Ticks, older events are ignored.
+        * \returns the events, oldest first.
+        */
+        std::vector<trace_event_t> snapshot(uint64_t since = 0) const {
+            std::vector<trace_event_t> result;
+            trace_event_t* events = m_events.load(std::memory_order::acquire);
+            if (events == nullptr) return result;
+
+            uint64_t head = m_head.load(std::memory_order::acquire);
+            uint64_t first = std::max(m_start.load(), head > c_capacity ? head - c_capacity : 0);
+            result.reserve(head - first);
+            for (uint64_t i = first; i < head; ++i) {
+                result.push_back(events[i & (c_capacity - 1)]);
+            }
+            std::atomic_thread_fence(std::memory_order::acquire);       //keep the copies above before the next load
+            uint64_t now = m_head.load(std::memory_order::relaxed);     //the owner may have overwritten some events meanwhile
+            //the owner may also be writing event 'now' right now, which shares its slot with event now - c_capacity
+            uint64_t lost = now + 1 > c_capacity + first ? std::min(now + 1 - c_capacity - first, (uint64_t)result.size()) : 0;
+            result.erase(result.begin(), result.begin() + lost);
+            std::erase_if(result, [&](const trace_event_t& ev) { return ev.m_t2 < since; });
+            return result;
+        }
+
+        /**
+        * \brief Forget all events recorded so far.
+        */
+        void clear() noexcept {
+            m_start = m_head.load();
+        }
     };
 
 
     /**
     * \brief General FIFO queue class.
     *
-    * The queue allows for multiple producers multiple consumers. It uses a lightweight
-    * atomic flag as lock. 
+    * The queue allows for multiple producers multiple consumers. By default it uses a lightweight
+    * spin lock, see default_policy_t for using std::mutex instead.
     */
-    template<typename JOB = Queuable, bool SYNC = true>
+    template<typename JOB = Queuable, bool SYNC = true, typename LOCK = policy_t::queue_lock_t>
     requires std::is_base_of_v<Queuable, JOB >
     class JobQueue {
         friend JobSystem;
-        std::atomic_flag m_lock = ATOMIC_FLAG_INIT;  //for locking the queue
+        LOCK             m_lock;                     //for locking the queue
+        std::atomic<uint32_t> m_high_water = 0;     //max number of jobs that have been in the queue
         JOB*             m_head = nullptr;	        //points to first entry
         JOB*             m_tail = nullptr;	        //points to last entry
         int32_t          m_size = 0;                 //number of entries in the queue
@@ -284,7 +930,7 @@ namespace vgjs {
 
         JobQueue() noexcept : m_head(nullptr), m_tail(nullptr), m_size(0) {};	///<JobQueue class constructor
 
-        JobQueue(const JobQueue<JOB>& queue) noexcept : m_head(nullptr), m_tail(nullptr), m_size(0) {};
+        JobQueue(const JobQueue& queue) noexcept : m_head(nullptr), m_tail(nullptr), m_size(0) {};
 
         /**
         * \brief Deallocate all Jobs in the queue.
@@ -295,7 +941,7 @@ namespace vgjs {
             uint32_t res = m_size;
             JOB* job = pop();                   //deallocate jobs that run a function
             while (job != nullptr) {            //because they were allocated by the JobSystem
-                auto da = job->get_deallocator(); //get deallocator
+                auto& da = job->get_deallocator(); //get deallocator
                 da.deallocate(job);             //deallocate the memory
                 job = pop();                    //get next entry
             }
@@ -310,22 +956,29 @@ namespace vgjs {
         */
         uint32_t size() {
             if constexpr (SYNC) {
-                while (m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+                m_lock.lock();     //acquire lock
             }
             auto s =  m_size;
             if constexpr (SYNC) {
-                m_lock.clear(std::memory_order::release); //release lock
+                m_lock.unlock();   //release lock
             }
             return s;
         }
 
+        /**
+        * \returns the max number of jobs that have been in the queue at the same time.
+        */
+        uint32_t high_water() const noexcept {
+            return m_high_water.load(std::memory_order::relaxed);
+        }
+
         /**
         * \brief Pushes a job onto the queue tail.
         * \param[in] job The job to be pushed into the queue.
         */
         void push(JOB* job) {
             if constexpr (SYNC) {
-                while (m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+                m_lock.lock();     //acquire lock
             }
             job->m_next = nullptr;      //clear pointer to successor
             if (m_head == nullptr) {    //if queue is empty
@@ -340,8 +993,35 @@ namespace vgjs {
             }
 
             m_size++;                   //increase size
+            if ((uint32_t)m_size > m_high_water.load(std::memory_order::relaxed)) m_high_water.store((uint32_t)m_size, std::memory_order::relaxed);
+            if constexpr (SYNC) {
+                m_lock.unlock();   //release lock
+            }
+        };
+
+        /**
+        * \brief Pushes a linked list of jobs onto the queue tail, taking the lock only once.
+        * \param[in] head First job of the list, linked through m_next.
+        * \param[in] tail Last job of the list.
+        * \param[in] num Number of jobs in the list.
+        */
+        void push_chain(JOB* head, JOB* tail, int32_t num) {
+            if (head == nullptr) return;
             if constexpr (SYNC) {
-                m_lock.clear(std::memory_order::release); //release lock
+                m_lock.lock();     //acquire lock
+            }
+            tail->m_next = nullptr;     //terminate the list
+            if (m_tail == nullptr) {    //if queue was empty
+                m_head = head;          //the list is the whole queue
+            }
+            else {
+                m_tail->m_next = head;  //append the list to the queue tail
+            }
+            m_tail = tail;              //m_tail points to the last job of the list
+            m_size += num;              //increase size
+            if ((uint32_t)m_size > m_high_water.load(std::memory_order::relaxed)) m_high_water.store((uint32_t)m_size, std::memory_order::relaxed);
+            if constexpr (SYNC) {
+                m_lock.unlock();   //release lock
             }
         };
 
@@ -353,7 +1033,7 @@ namespace vgjs {
             if (m_head == nullptr) return nullptr;
 
             if constexpr (SYNC) {
-                while (m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+                m_lock.lock();     //acquire lock
             }
 
             JOB* head = m_head;
@@ -365,13 +1045,529 @@ namespace vgjs {
                 }
             }
             if constexpr (SYNC) {
-                m_lock.clear(std::memory_order::release);   //release lock
+                m_lock.unlock();   //release lock
             }
             return head;
         };
 
-    };
-
+        /**
+        * \brief Take all jobs from the queue at once.
+        * \param[out] num Number of jobs that were taken.
+        * \returns the head of the list of jobs, linked through m_next, or nullptr.
+        */
+        JOB* pop_all(int32_t& num) {
+            if constexpr (SYNC) {
+                m_lock.lock();     //acquire lock
+            }
+            JOB* head = m_head;
+            num = m_size;
+            m_head = nullptr;
+            m_tail = nullptr;
+            m_size = 0;
+            if constexpr (SYNC) {
+                m_lock.unlock();   //release lock
+            }
+            return head;
+        };
+
+    };
+
+
+    /**
+    * \brief Queue of jobs with deadlines, the job with the earliest deadline is taken first.
+    *
+    * The jobs are kept in a binary heap protected by the same lock type as JobQueue. Multiple
+    * producers push jobs, and the owner as well as thieves pop them.
+    */
+    class DeadlineQueue {
+        policy_t::queue_lock_t      m_lock;                 //for locking the queue
+        std::vector<Job_base*>      m_heap;                 //heap ordered by m_deadline
+        std::atomic<uint32_t>       m_size = 0;             //number of jobs, can be read without lock
+
+        static bool later(Job_base* a, Job_base* b) noexcept { return a->m_deadline > b->m_deadline; }
+
+    public:
+
+        /**
+        * \brief Get the number of jobs currently in the queue.
+        * \returns the number of jobs currently in the queue.
+        */
+        uint32_t size() const noexcept {
+            return m_size.load(std::memory_order::relaxed);
+        }
+
+        /**
+        * \brief Put a job into the queue.
+        * \param[in] job The job, must have a deadline.
+        */
+        void push(Job_base* job) {
+            std::lock_guard<policy_t::queue_lock_t> lock(m_lock);
+            m_heap.push_back(job);
+            std::push_heap(m_heap.begin(), m_heap.end(), later);
+            m_size.store((uint32_t)m_heap.size(), std::memory_order::relaxed);
+        }
+
+        /**
+        * \brief Take the job with the earliest deadline.
+        * \returns the job, or nullptr if the queue is empty.
+        */
+        Job_base* pop() {
+            if (size() == 0) return nullptr;
+            std::lock_guard<policy_t::queue_lock_t> lock(m_lock);
+            if (m_heap.empty()) return nullptr;
+            std::pop_heap(m_heap.begin(), m_heap.end(), later);
+            Job_base* job = m_heap.back();
+            m_heap.pop_back();
+            m_size.store((uint32_t)m_heap.size(), std::memory_order::relaxed);
+            return job;
+        }
+
+        /**
+        * \brief Deallocate all jobs in the queue.
+        */
+        void clear() {
+            for (Job_base* job = pop(); job != nullptr; job = pop()) {
+                job->get_deallocator().deallocate(job);
+            }
+        }
+    };
+
+
+    /**
+    * \brief Lock-free work stealing deque (Chase-Lev).
+    *
+    * The deque has exactly one owner thread which pushes and pops jobs at the bottom.
+    * Any other thread may steal jobs from the top. Owner push and pop need no atomic
+    * read-modify-write, only the last remaining job is contended using a CAS.
+    * If the ring buffer is full, the owner replaces it by a buffer of twice the size.
+    * Old buffers are kept until the deque is destroyed, since thieves might still read from them.
+    */
+    template<typename JOB = Queuable>
+    requires std::is_base_of_v<Queuable, JOB >
+    class JobDeque {
+        static inline const int64_t c_initial_capacity = 1 << 10;  ///<initial number of slots
+
+        /**
+        * \brief Ring buffer holding the job pointers, the capacity is a power of 2.
+        */
+        struct Buffer {
+            int64_t                               m_capacity;    ///<number of slots
+            int64_t                               m_mask;        ///<capacity - 1
+            std::unique_ptr<std::atomic<JOB*>[]>  m_slots;       ///<the job pointers
+
+            Buffer(int64_t capacity) : m_capacity(capacity), m_mask(capacity - 1), m_slots(new std::atomic<JOB*>[capacity]) {};
+
+            JOB* get(int64_t i) noexcept { return m_slots[i & m_mask].load(std::memory_order::relaxed); }
+            void put(int64_t i, JOB* job) noexcept { m_slots[i & m_mask].store(job, std::memory_order::relaxed); }
+
+            Buffer* grow(int64_t bottom, int64_t top) {
+                Buffer* buffer = new Buffer(2 * m_capacity);
+                for (int64_t i = top; i < bottom; ++i) buffer->put(i, get(i));  //copy all jobs
+                return buffer;
+            }
+        };
+
+        alignas(64) std::atomic<int64_t>    m_top = 0;       ///<thieves steal here
+        alignas(64) std::atomic<int64_t>    m_bottom = 0;    ///<owner pushes and pops here
+        std::atomic<Buffer*>                m_buffer;        ///<current ring buffer
+        std::vector<std::unique_ptr<Buffer>> m_buffers;      ///<all buffers ever used, owned by the deque
+        std::atomic<uint32_t>               m_high_water = 0;///<max number of jobs that have been in the deque
+
+    public:
+
+        JobDeque() noexcept {   ///<JobDeque class constructor
+            m_buffers.emplace_back(std::make_unique<Buffer>(c_initial_capacity));
+            m_buffer = m_buffers.back().get();
+        };
+
+        JobDeque(const JobDeque<JOB>&) = delete;
+        ~JobDeque() {}  //destructor
+
+        /**
+        * \brief Deallocate all Jobs in the deque. Must be called by the owner.
+        */
+        uint32_t clear() {
+            uint32_t res = size();
+            JOB* job = pop();
+            while (job != nullptr) {
+                auto& da = job->get_deallocator(); //get deallocator
+                da.deallocate(job);             //deallocate the memory
+                job = pop();                    //get next entry
+            }
+            return res;
+        }
+
+        /**
+        * \brief Get the number of jobs currently in the deque (approximate if other threads are working on it).
+        * \returns the number of jobs currently in the deque.
+        */
+        uint32_t size() {
+            int64_t s = m_bottom.load(std::memory_order::relaxed) - m_top.load(std::memory_order::relaxed);
+            return s > 0 ? (uint32_t)s : 0;
+        }
+
+        /**
+        * \brief Owner pushes a job onto the bottom of the deque.
+        * \param[in] job The job to be pushed into the deque.
+        */
+        void push(JOB* job) {
+            int64_t b = m_bottom.load(std::memory_order::relaxed);
+            int64_t t = m_top.load(std::memory_order::acquire);
+            Buffer* buffer = m_buffer.load(std::memory_order::relaxed);
+            if (b - t > buffer->m_capacity - 1) {       //full - get a larger buffer
+                m_buffers.emplace_back(buffer->grow(b, t));
+                buffer = m_buffers.back().get();
+                m_buffer.store(buffer, std::memory_order::release);
+            }
+            buffer->put(b, job);
+            std::atomic_thread_fence(std::memory_order::release);
+            m_bottom.store(b + 1, std::memory_order::relaxed);
+            if (b + 1 - t > m_high_water.load(std::memory_order::relaxed)) m_high_water.store((uint32_t)(b + 1 - t), std::memory_order::relaxed);
+        }
+
+        /**
+        * \returns the max number of jobs that have been in the deque at the same time.
+        */
+        uint32_t high_water() const noexcept {
+            return m_high_water.load(std::memory_order::relaxed);
+        }
+
+        /**
+        * \brief Owner pops a job from the bottom of the deque.
+        * \returns a job or nullptr.
+        */
+        JOB* pop() {
+            int64_t b = m_bottom.load(std::memory_order::relaxed);
+            if (b <= m_top.load(std::memory_order::relaxed)) return nullptr;    //top only grows, so the deque is empty
+
+            b = b - 1;
+            Buffer* buffer = m_buffer.load(std::memory_order::relaxed);
+            m_bottom.store(b, std::memory_order::relaxed);
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            int64_t t = m_top.load(std::memory_order::relaxed);
+
+            if (t > b) {                                //a thief took the last job
+                m_bottom.store(b + 1, std::memory_order::relaxed);
+                return nullptr;
+            }
+
+            JOB* job = buffer->get(b);
+            if (t == b) {                               //last job - race against thieves
+                if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed)) {
+                    job = nullptr;                      //a thief won
+                }
+                m_bottom.store(b + 1, std::memory_order::relaxed);
+            }
+            return job;
+        }
+
+        /**
+        * \brief Any thread can steal a job from the top of the deque.
+        * \returns a job or nullptr.
+        */
+        JOB* steal() {
+            int64_t t = m_top.load(std::memory_order::acquire);
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            int64_t b = m_bottom.load(std::memory_order::acquire);
+            if (t >= b) return nullptr;                 //empty
+
+            Buffer* buffer = m_buffer.load(std::memory_order::acquire);
+            JOB* job = buffer->get(t);
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed)) {
+                return nullptr;                         //lost the race against the owner or another thief
+            }
+            return job;
+        }
+    };
+
+
+    /**
+    * \brief Thread safe map from tags to the queues holding the jobs scheduled for them.
+    *
+    * Tags 0..c_dense_size-1 map directly to a preallocated array of queues, so using them needs no
+    * lookup at all. Larger tags are distributed over c_num_shards hash maps, each guarded by its own lock,
+    * so producers using different tags rarely contend. Queues are never removed, so a queue
+    * pointer stays valid after the shard lock is released.
+    */
+    class TagRegistry {
+        static inline const int32_t  c_dense_size = 1 << 10;   ///<tags below this use the dense array
+        static inline const uint32_t c_num_shards = 1 << 4;    ///<number of maps for large tags
+
+        struct alignas(64) shard_t {
+            std::atomic_flag m_lock = ATOMIC_FLAG_INIT;
+            std::unordered_map<tag_t, std::unique_ptr<JobQueue<Job_base>>, tag_t::hash> m_queues;
+        };
+
+        std::vector<JobQueue<Job_base>> m_dense{ (std::size_t)c_dense_size };  ///<queues of the small tags
+        shard_t                         m_shards[c_num_shards];                ///<queues of the large tags
+
+    public:
+
+        /**
+        * \brief Find the queue of a tag.
+        * \param[in] tg The tag.
+        * \param[in] create If true then a missing queue is created.
+        * \returns a pointer to the queue, or nullptr if it does not exist.
+        */
+        JobQueue<Job_base>* get(tag_t tg, bool create = true) {
+            if (tg.value < c_dense_size) return &m_dense[tg.value];
+
+            shard_t& shard = m_shards[tag_t::hash()(tg) % c_num_shards];
+            while (shard.m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+            JobQueue<Job_base>* queue = nullptr;
+            auto it = shard.m_queues.find(tg);
+            if (it != shard.m_queues.end()) {
+                queue = it->second.get();
+            }
+            else if (create) {
+                queue = (shard.m_queues[tg] = std::make_unique<JobQueue<Job_base>>()).get();
+            }
+            shard.m_lock.clear(std::memory_order::release);                 //release lock
+            return queue;
+        }
+
+        /**
+        * \brief Deallocate the jobs of all tags.
+        */
+        void clear() {
+            for (auto& queue : m_dense) queue.clear();
+            for (auto& shard : m_shards) {
+                while (shard.m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+                for (auto& [tg, queue] : shard.m_queues) queue->clear();
+                shard.m_lock.clear(std::memory_order::release);                 //release lock
+            }
+        }
+    };
+
+
+    //----------------------------------------------------------------------------------
+    //CPU topology
+
+    /**
+    * \brief A logical CPU (hardware thread) and the domains it belongs to. -1 means unknown.
+    */
+    struct cpu_t {
+        uint32_t    m_cpu = 0;      ///<number of the logical CPU used by the OS
+        int64_t     m_core = -1;    ///<physical core, SMT siblings share it
+        int64_t     m_l3 = -1;      ///<L3 cache domain
+        int64_t     m_node = -1;    ///<NUMA node
+
+        /**
+        * \brief Distance between two CPUs, used for the steal order.
+        * \param[in] other The other CPU.
+        * \returns 0 for SMT siblings, 1 for the same L3 cache, 2 for the same NUMA node, else 3.
+        */
+        uint32_t distance(const cpu_t& other) const noexcept {
+            if (m_core >= 0 && m_core == other.m_core) return 0;
+            if (m_l3 >= 0 && m_l3 == other.m_l3) return 1;
+            if (m_node == other.m_node) return 2;
+            return 3;
+        }
+    };
+
+    /**
+    * \brief How worker threads are placed onto the CPUs.
+    */
+    struct affinity_t {
+        bool                    m_pin = false;      ///<if true then each worker thread is pinned to one CPU
+        std::vector<uint32_t>   m_reserved_cpus;    ///<CPUs not used for workers, e.g. for a render thread
+    };
+
+#if defined(__linux__)
+    /**
+    * \brief Read the first integer from a sysfs file.
+    * \param[in] path Path of the file.
+    * \returns the number, or -1 if the file does not exist.
+    */
+    inline int64_t read_sysfs_int(const std::string& path) {
+        std::ifstream file(path);
+        int64_t value = -1;
+        if (file) file >> value;
+        return value;
+    }
+#endif
+
+    /**
+    * \brief Get the CPUs this process may run on, together with their cores, L3 domains and NUMA nodes.
+    * \returns a vector of CPUs, empty if the topology cannot be determined on this platform.
+    */
+    inline std::vector<cpu_t> get_cpu_topology() {
+        std::vector<cpu_t> cpus;
+#if defined(_WIN32)
+        DWORD length = 0;
+        GetLogicalProcessorInformation(nullptr, &length);
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+        if (info.empty() || !GetLogicalProcessorInformation(info.data(), &length)) return cpus;
+
+        std::vector<cpu_t> all(sizeof(ULONG_PTR) * 8);
+        int64_t core = 0, l3 = 0;
+        for (auto& entry : info) {
+            for (uint32_t i = 0; i < all.size(); ++i) {
+                if ((entry.ProcessorMask & ((ULONG_PTR)1 << i)) == 0) continue;
+                all[i].m_cpu = i;
+                if (entry.Relationship == RelationProcessorCore) all[i].m_core = core;
+                else if (entry.Relationship == RelationCache && entry.Cache.Level == 3) all[i].m_l3 = l3;
+                else if (entry.Relationship == RelationNumaNode) all[i].m_node = entry.NumaNode.NodeNumber;
+            }
+            if (entry.Relationship == RelationProcessorCore) ++core;
+            if (entry.Relationship == RelationCache && entry.Cache.Level == 3) ++l3;
+        }
+        for (auto& cpu : all) {
+            if (cpu.m_core >= 0) cpus.push_back(cpu);
+        }
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+
+        for (uint32_t i = 0; i < CPU_SETSIZE; ++i) {
+            if (!CPU_ISSET(i, &set)) continue;
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(i);
+            cpu_t cpu{ i };
+            int64_t package = read_sysfs_int(base + "/topology/physical_package_id");
+            int64_t core = read_sysfs_int(base + "/topology/core_id");
+            if (core >= 0) cpu.m_core = (std::max<int64_t>(package, 0) << 32) + core;
+
+            for (int index = 0; ; ++index) {        //find the L3 cache, its id is the first CPU sharing it
+                int64_t level = read_sysfs_int(base + "/cache/index" + std::to_string(index) + "/level");
+                if (level < 0) break;
+                if (level == 3) {
+                    cpu.m_l3 = read_sysfs_int(base + "/cache/index" + std::to_string(index) + "/shared_cpu_list");
+                    break;
+                }
+            }
+
+            std::error_code ec;
+            for (auto& entry : std::filesystem::directory_iterator(base, ec)) {     //the node is a link named nodeN
+                std::string name = entry.path().filename().string();
+                if (name.size() > 4 && name.compare(0, 4, "node") == 0 && std::isdigit((unsigned char)name[4])) {
+                    cpu.m_node = std::stoll(name.substr(4));
+                    break;
+                }
+            }
+            cpus.push_back(cpu);
+        }
+#endif
+        return cpus;
+    }
+
+    /**
+    * \brief Pin the calling thread to one CPU.
+    * \param[in] cpu Number of the logical CPU.
+    * \returns true if the thread was pinned.
+    */
+    inline bool pin_current_thread(uint32_t cpu) noexcept {
+#if defined(_WIN32)
+        if (cpu >= sizeof(DWORD_PTR) * 8) return false;
+        return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+
+    //----------------------------------------------------------------------------------
+    //Metrics
+
+    /**
+    * \brief Counters of one worker thread. Always on, written only by the owner thread.
+    *
+    * Execution times are counted in histograms, one per job type. Bucket i counts jobs that took
+    * less than 2^i ticks of trace_ticks() (ticks are converted to ns with metrics_t::m_ns_per_tick).
+    */
+    struct alignas(64) thread_metrics_t {
+        static inline const uint32_t c_num_types = 16;      ///<types 0..c_num_types-1 get their own histogram, all others share the last one
+        static inline const uint32_t c_num_buckets = 40;    ///<number of buckets per histogram
+
+        std::atomic<uint64_t>   m_jobs = 0;             ///<jobs executed
+        std::atomic<uint64_t>   m_steals = 0;           ///<jobs stolen from other threads
+        std::atomic<uint64_t>   m_failed_steals = 0;    ///<rounds over all priorities and other threads without finding a job
+        std::atomic<uint64_t>   m_parks = 0;            ///<number of times the thread parked
+        std::atomic<uint64_t>   m_parked_ns = 0;        ///<time spent parked in nanoseconds
+        std::atomic<uint64_t>   m_cancelled = 0;        ///<Functions skipped because they were cancelled
+        std::atomic<uint64_t>   m_deferred = 0;         ///<optional Functions deferred to the next frame
+        std::array<std::array<std::atomic<uint64_t>, c_num_buckets>, c_num_types + 1> m_histograms{};  ///<execution times per type
+        std::array<std::atomic<uint64_t>, c_num_types + 1> m_missed{};  ///<jobs per type that ended after their deadline
+
+        /**
+        * \brief Add a value to a counter. Only the owner writes, so no read-modify-write is needed.
+        * \param[in] counter The counter.
+        * \param[in] value The value to add.
+        */
+        static void add(std::atomic<uint64_t>& counter, uint64_t value = 1) noexcept {
+            if constexpr (!policy_t::c_enable_metrics) return;
+            counter.store(counter.load(std::memory_order::relaxed) + value, std::memory_order::relaxed);
+        }
+
+        /**
+        * \brief Count an executed job.
+        * \param[in] type The type of the job.
+        * \param[in] ticks Execution time in ticks.
+        */
+        void job_executed(thread_type_t type, uint64_t ticks) noexcept {
+            if constexpr (!policy_t::c_enable_metrics) return;
+            add(m_jobs);
+            uint32_t t = type.value >= 0 && type.value < (int)c_num_types ? type.value : c_num_types;
+            uint32_t b = std::min((uint32_t)std::bit_width(ticks), c_num_buckets - 1);
+            add(m_histograms[t][b]);
+        }
+
+        /**
+        * \brief Count a job that ended after its deadline.
+        * \param[in] type The type of the job.
+        */
+        void deadline_missed(thread_type_t type) noexcept {
+            add(m_missed[type.value >= 0 && type.value < (int)c_num_types ? type.value : c_num_types]);
+        }
+    };
+
+    /**
+    * \brief Deadline misses of a finished frame, see JobSystem::get_frame_report().
+    */
+    struct frame_report_t {
+        uint64_t                    m_frame = 0;        ///<number of the frame
+        std::chrono::nanoseconds    m_duration{ 0 };    ///<time from the start of the frame until next_frame()
+        bool                        m_overrun = false;  ///<true if the frame took longer than its budget
+        uint64_t                    m_deferred = 0;     ///<optional Functions deferred to the next frame
+        std::vector<std::pair<thread_type_t, uint64_t>> m_missed;  ///<jobs that ended after their deadline, for each type that had misses. Types >= 16 are counted as thread_type_t{}
+    };
+
+    /**
+    * \brief Snapshot of the runtime metrics of the job system, see JobSystem::get_metrics().
+    */
+    struct metrics_t {
+        struct thread_t {
+            uint64_t    m_jobs = 0;             ///<jobs executed
+            uint64_t    m_steals = 0;           ///<jobs stolen from other threads
+            uint64_t    m_failed_steals = 0;    ///<rounds over all priorities and other threads without finding a job
+            uint64_t    m_parks = 0;            ///<number of times the thread parked
+            uint64_t    m_parked_ns = 0;        ///<time spent parked in nanoseconds
+            uint64_t    m_cancelled = 0;        ///<Functions skipped because they were cancelled
+            uint64_t    m_pool_hits = 0;        ///<Job allocations served by the pool
+            uint64_t    m_pool_misses = 0;      ///<Job allocations that needed a new slab
+            uint32_t    m_queue_high_water = 0; ///<max number of jobs in any of the thread's queues
+        };
+        using histogram_t = std::array<uint64_t, thread_metrics_t::c_num_buckets>;
+
+        std::vector<thread_t>   m_threads;      ///<counters of each thread
+        std::array<histogram_t, thread_metrics_t::c_num_types + 1> m_histograms{};  ///<execution times per type, summed over all threads
+        double                  m_ns_per_tick = 1.0;    ///<to convert histogram buckets to ns
+
+        /**
+        * \brief Get the upper bound of a histogram bucket.
+        * \param[in] bucket The bucket.
+        * \returns the upper bound of the bucket in nanoseconds.
+        */
+        double bucket_limit_ns(uint32_t bucket) const noexcept {
+            return std::ldexp(1.0, bucket) * m_ns_per_tick;
+        }
+    };
+
 
     /**
     * \brief The main JobSystem class manages the whole VGJS job system.
@@ -380,53 +1576,90 @@ namespace vgjs {
     * It can add new jobs, and wait until they are done.
     */
     class JobSystem {
-        static inline const uint32_t c_queue_capacity = 1<<10; ///<save at most N Jobs for recycling
-        static inline const bool c_enable_logging = true;
+        static inline const bool c_enable_logging = policy_t::c_enable_logging;    ///<see default_policy_t
+        static inline const bool c_enable_metrics = policy_t::c_enable_metrics;
 
     private:
         static inline std::atomic<uint64_t>             m_init_counter = 0;
+        static inline bool                              m_restartable = false;  ///<threads have been joined, an explicit constructor call starts a new system
         static inline n_pmr::memory_resource*           m_mr;                   ///<use to allocate/deallocate Jobs
         static inline std::vector<std::thread>	        m_threads;	            ///<array of thread structures
+        struct thread_guard_t {                             ///<threads that were never joined must not terminate the program at exit
+            ~thread_guard_t() { for (auto& thread : m_threads) if (thread.joinable()) thread.detach(); }
+        };
+        static inline thread_guard_t                    m_thread_guard;         ///<destroyed before m_threads
+        static inline std::mutex                        m_init_mutex;           ///<for joining the threads
         static inline std::atomic<uint32_t>   		    m_thread_count = 0;     ///<number of threads in the pool
         static inline std::atomic<bool>                 m_terminated = false;   ///<flag set true when the last thread has exited
         static inline thread_index_t				    m_start_idx;            ///<idx of first thread that is created
         static inline thread_local thread_index_t	    m_thread_index = thread_index_t{};  ///<each thread has its own number
         static inline std::atomic<bool>				    m_terminate = false;	///<Flag for terminating the pool
         static inline thread_local Job_base*            m_current_job = nullptr;///<Pointer to the current job of this thread0
-        static inline std::vector<JobQueue<Job_base>>   m_global_queues;	    ///<each thread has its own Job queue, multiple produce, single consume
-        static inline std::vector<JobQueue<Job_base>>   m_local_queues;	        ///<each thread has its own Job queue, multiple produce, single consume
+        static inline thread_local bool                 m_adopted = false;      ///<true if this thread took a reserved index in run_until()
+        static inline thread_local uint32_t             m_since_background = 0; ///<jobs run since the last background job
+        static inline thread_local uint32_t             m_next_victim = 0;      ///<where to start stealing if threads are not pinned
+        static inline std::atomic<uint32_t>             m_threads_to_start = 0; ///<counted down when threads enter the system
+        static inline std::atomic<int>                  m_next_reserved = 0;    ///<next reserved thread index that run_until() can take
+        static inline const uint32_t c_num_priorities = 3;          ///<high, normal, background
+        static inline const uint32_t c_background_interval = 1 << 4; ///<background work is tried first after this many other jobs
+        static inline std::vector<JobQueue<Job_base>>   m_global_queues[c_num_priorities];	///<each thread has one Job queue per priority, multiple produce, single consume
+        static inline std::vector<JobQueue<Job_base>>   m_local_queues[c_num_priorities];	///<each thread has one Job queue per priority, multiple produce, single consume
+        static inline std::vector<std::unique_ptr<JobDeque<Job_base>>>                          m_deques;   ///<each thread has its own work stealing deque for normal priority, single produce, multiple consume
+        static inline std::vector<std::unique_ptr<DeadlineQueue>>   m_deadline_queues[c_num_priorities];   ///<jobs with deadlines, each thread has one per priority, earliest deadline first
         static inline std::vector<std::unique_ptr<std::condition_variable>>                     m_cv;
         static inline std::vector<std::unique_ptr<std::mutex>>                                  m_mutex;
-        static inline std::unordered_map<tag_t,std::unique_ptr<JobQueue<Job_base>>,tag_t::hash> m_tag_queues;
-        static inline thread_local JobQueue<Job,false>      m_recycle;        ///<save old jobs for recycling
-        static inline thread_local JobQueue<Job,false>      m_delete;         ///<save old jobs for deleting
-        static inline n_pmr::vector<n_pmr::vector<JobLog>>	m_logs;				    ///< log the start and stop times of jobs
-        static inline bool                                  m_logging = false;      ///< if true then jobs will be logged
+        struct alignas(64) sleep_flag_t { std::atomic<bool> m_value = false; };
+        static inline std::vector<std::unique_ptr<sleep_flag_t>> m_sleeping;  ///<true if the thread is parked on its condition variable
+        static inline std::atomic<uint32_t>                 m_num_sleeping = 0; ///<number of parked threads
+        static inline idle_policy_t                         m_idle_policy = policy_t::c_idle_policy;  ///<how threads behave when there is no work
+        static inline std::mutex                            m_idle_policy_mutex;
+        static inline TagRegistry                           m_tag_queues;       ///<jobs waiting for their tag to be scheduled
+        static inline std::vector<std::unique_ptr<JobPool>> m_pools;          ///<one Job pool per thread, plus a shared pool for other threads
+        static inline std::vector<cpu_t>                    m_worker_cpus;    ///<CPU of each worker thread, empty if threads are not pinned
+        static inline std::vector<std::vector<uint32_t>>    m_steal_order;    ///<for each thread the other threads, closest first
+        static inline std::vector<std::unique_ptr<TraceBuffer>> m_traces;       ///< log the start and stop times of jobs, one ring buffer per thread
+        static inline std::vector<std::unique_ptr<thread_metrics_t>> m_metrics; ///< always on counters, one set per thread
+        static inline const uint32_t c_frames_in_flight = 2;                    ///<memory of a frame lives until this many frames have started
+        static inline std::vector<std::unique_ptr<FrameArena>> m_arenas;        ///<c_frames_in_flight arenas per thread, plus shared arenas for other threads
+        static inline std::atomic_flag                      m_arena_lock = ATOMIC_FLAG_INIT; ///<lock for the shared arenas
+        static inline std::atomic<uint64_t>                 m_frame = 0;        ///<number of the current frame
+        static inline FrameResource                         m_frame_resource;   ///<allocates from the arenas of the current frame
+        static inline std::atomic<uint64_t>                 m_frame_start = 0;  ///<trace_nanoseconds() when the current frame started
+        static inline std::atomic<uint64_t>                 m_frame_length = 0; ///<frame budget in ns, 0 for none
+        static inline std::atomic<uint64_t>                 m_defer_after = Job_base::c_no_deadline;  ///<optional jobs starting after this are deferred
+        static inline std::atomic<int>                      m_defer_tag = -1;   ///<tag for deferred jobs
+        static inline std::mutex                            m_frame_mutex;      ///<protects the frame budget and report
+        static inline frame_budget_t                        m_frame_budget;     ///<see set_frame_budget()
+        static inline frame_report_t                        m_frame_report;     ///<report of the last finished frame
+        static inline std::array<uint64_t, thread_metrics_t::c_num_types + 2> m_frame_counts{};  ///<deadline misses per type and deferred jobs when the frame started
+        static inline std::atomic<bool>                     m_logging = false;      ///< if true then jobs will be logged
         static inline std::map<int32_t, std::string>        m_types;                ///<map types to a string for logging
         static inline std::chrono::time_point<std::chrono::high_resolution_clock> m_start_time = std::chrono::high_resolution_clock::now();	//time when program started
+        static inline uint64_t                              m_start_ticks = trace_ticks();          ///<ticks when program started
+        static inline uint64_t                              m_start_ns = trace_nanoseconds();       ///<nanoseconds when program started
+
+        /**
+        * \brief Get the Job pool of the current thread.
+        * \returns the pool of this worker thread, or the shared pool if this is not a worker thread.
+        */
+        JobPool* get_pool() noexcept {
+            if (m_thread_index.value >= 0 && m_thread_index.value + 1 < (int)m_pools.size()) {
+                return m_pools[m_thread_index.value].get();
+            }
+            return m_pools.back().get();
+        }
 
         /**
         * \brief Allocate a job so that it can be scheduled.
         * 
-        * If there is a job in the recycle queue we use this. Else a new
-        * new Job struct is allocated from the memory resource m_mr.
+        * The Job is taken from the pool of the current thread. Only if the pool is empty
+        * new Jobs are allocated from the memory resource m_mr.
         * 
         * \returns a pointer to the job.
         */
         Job* allocate_job() {
-            Job* job = m_recycle.pop();                                 //try recycle queue
-            if (job == nullptr ) {                                      //none found
-                n_pmr::polymorphic_allocator<Job> allocator(m_mr);      //use this allocator
-                job = allocator.allocate(1);                            //allocate the object
-                if (job == nullptr) {
-                    std::cout << "No job available\n";
-                    std::terminate();
-                }
-                new (job) Job(m_mr);                 //call constructor
-            }
-            else {                                  //job found
-                job->reset();                       //reset it
-            }
+            Job* job = get_pool()->allocate();      //try the pool
+            job->reset();                           //reset it
             return job;
         }
 
@@ -440,18 +1673,23 @@ namespace vgjs {
         Job* allocate_job(F&& f) noexcept {
             Job* job = allocate_job();
             if constexpr (std::is_same_v<std::decay_t<F>, Function>) {
-                job->m_function     = f.get_function();
+                job->m_function     = std::forward<F>(f).get_function();
                 job->m_pfvoid       = nullptr;
                 job->m_thread_index = f.m_thread_index;
                 job->m_type         = f.m_type;
                 job->m_id           = f.m_id;
+                job->m_priority     = f.m_priority;
+                job->m_token        = f.m_token;
+                job->m_placement    = f.m_placement;
+                job->m_deadline     = deadline(f.m_budget);
+                job->m_optional     = f.m_budget.m_optional;
             }
             else {
                 if constexpr (std::is_pointer_v<std::remove_reference_t<decltype(f)>>) {
                     job->m_pfvoid = f;
                 }
                 else {
-                    job->m_function = f; //std::function<void(void)> or a lambda
+                    job->m_function = std::forward<F>(f); //std::function<void(void)> or a lambda, stored inline
                     job->m_pfvoid = nullptr;
                 }
             }
@@ -464,16 +1702,16 @@ namespace vgjs {
         }
 
 
-    public:
-
         /**
-        * \brief JobSystem class constructor.
+        * \brief Start the system, unless it is already running or has been started before.
         * \param[in] threadCount Number of threads in the system.
         * \param[in] start_idx Number of first thread, if 1 then the main thread should enter as thread 0.
         * \param[in] mr The memory resource to use for allocating Jobs.
+        * \param[in] jobs_per_thread Number of Jobs that are allocated up front for each thread.
+        * \param[in] affinity Whether to pin worker threads to CPUs, and which CPUs to leave free.
         */
-        JobSystem(thread_count_t threadCount = thread_count_t(0), thread_index_t start_idx = thread_index_t(0)
-            , n_pmr::memory_resource* mr = n_pmr::new_delete_resource()) noexcept {
+        void start(thread_count_t threadCount, thread_index_t start_idx, n_pmr::memory_resource* mr
+            , uint32_t jobs_per_thread, const affinity_t& affinity) noexcept {
 
             if (m_init_counter > 0) return;
             auto cnt = m_init_counter.fetch_add(1);
@@ -483,6 +1721,8 @@ namespace vgjs {
             m_start_idx = start_idx;
             m_terminate = false;
             m_terminated = false;
+            m_next_reserved = 0;
+            m_num_sleeping = 0;
 
             m_thread_count = threadCount.value;
             if (m_thread_count <= 0) {
@@ -492,20 +1732,98 @@ namespace vgjs {
                 m_thread_count = 1;
             }
 
+            m_worker_cpus.clear();
+            if (affinity.m_pin) {
+                m_worker_cpus = place_threads(affinity);
+                if (threadCount.value <= 0 && !m_worker_cpus.empty()) {
+                    m_thread_count = (uint32_t)m_worker_cpus.size();   //one thread per available CPU
+                }
+            }
+            compute_steal_order();
+
+            m_threads.clear();                  //remove what is left from a previous run
+            for (uint32_t p = 0; p < c_num_priorities; ++p) {
+                m_global_queues[p].clear();
+                m_local_queues[p].clear();
+                m_deadline_queues[p].clear();
+            }
+            m_deques.clear();
+            m_cv.clear();
+            m_mutex.clear();
+            m_sleeping.clear();
+            m_pools.clear();
+
             for (uint32_t i = 0; i < m_thread_count; i++) {
-                m_global_queues.push_back(JobQueue<Job_base>());     //global job queue
-                m_local_queues.push_back(JobQueue<Job_base>());     //local job queue
+                for (uint32_t p = 0; p < c_num_priorities; ++p) {
+                    m_global_queues[p].push_back(JobQueue<Job_base>());     //global job queue
+                    m_local_queues[p].push_back(JobQueue<Job_base>());      //local job queue
+                    m_deadline_queues[p].emplace_back(std::make_unique<DeadlineQueue>());   //jobs with deadlines
+                }
+                m_deques.emplace_back(std::make_unique<JobDeque<Job_base>>());  //work stealing deque
                 m_cv.emplace_back(std::make_unique<std::condition_variable>());
                 m_mutex.emplace_back(std::make_unique<std::mutex>());
+                m_sleeping.emplace_back(std::make_unique<sleep_flag_t>());
+                m_pools.emplace_back(std::make_unique<JobPool>(mr));    //Job pool of the thread
+                m_pools.back()->reserve(jobs_per_thread);
             }
+            m_pools.emplace_back(std::make_unique<JobPool>(mr, true));  //shared pool for other threads
+            m_pools.back()->reserve(jobs_per_thread);
 
+            m_traces.clear();
+            m_metrics.clear();
+            for (uint32_t i = 0; i < m_thread_count; i++) {
+                m_traces.emplace_back(std::make_unique<TraceBuffer>());   //buffers allocate their events when they are first used
+                m_metrics.emplace_back(std::make_unique<thread_metrics_t>());
+            }
+
+            m_arenas.clear();
+            m_frame = 0;
+            m_frame_start = trace_nanoseconds();
+            m_frame_counts.fill(0);
+            m_frame_report = frame_report_t{};
+            for (uint32_t i = 0; i < (m_thread_count + 1) * c_frames_in_flight; i++) {
+                m_arenas.emplace_back(std::make_unique<FrameArena>(mr));    //the last ones are shared by other threads
+            }
+
+            m_threads_to_start = m_thread_count.load();
             for (uint32_t i = start_idx.value; i < m_thread_count; i++) {
                 //std::cout << "Starting thread " << i << std::endl;
                 m_threads.push_back(std::thread(&JobSystem::thread_task, this, thread_index_t(i) ));	//spawn the pool threads
-                m_threads[i].detach();
             }
+        };
+
+    public:
+
+        /**
+        * \brief Access the job system. Starts it with default parameters if it has never been started.
+        *
+        * After a shutdown this does not start a new system, so late calls, e.g. from an I/O completion,
+        * cannot spawn threads again. Use the constructor with parameters for restarting.
+        */
+        JobSystem() noexcept {
+            start(thread_count_t(0), thread_index_t(0), n_pmr::new_delete_resource(), 0, affinity_t{});
+        };
 
-            m_logs.resize(m_thread_count, n_pmr::vector<JobLog>{mr});    //make room for the log files
+        /**
+        * \brief JobSystem class constructor. Starts the system if it is not running, also again after
+        * wait_for_termination() has joined the threads of a previous system.
+        * \param[in] threadCount Number of threads in the system, 0 for one per hardware thread.
+        * \param[in] start_idx Number of first thread, if 1 then the main thread should enter as thread 0.
+        * \param[in] mr The memory resource to use for allocating Jobs.
+        * \param[in] jobs_per_thread Number of Jobs that are allocated up front for each thread.
+        * \param[in] affinity Whether to pin worker threads to CPUs, and which CPUs to leave free.
+        */
+        explicit JobSystem(thread_count_t threadCount, thread_index_t start_idx = thread_index_t(0)
+            , n_pmr::memory_resource* mr = n_pmr::new_delete_resource(), uint32_t jobs_per_thread = 0
+            , const affinity_t& affinity = affinity_t{}) noexcept {
+            {
+                std::lock_guard<std::mutex> lock(m_init_mutex);
+                if (m_restartable) {
+                    m_restartable = false;
+                    m_init_counter = 0;     //a new system
+                }
+            }
+            start(threadCount, start_idx, mr, jobs_per_thread, affinity);
         };
 
 
@@ -523,31 +1841,345 @@ namespace vgjs {
         JobSystem& operator=(JobSystem&&) = default;
         ~JobSystem() = default;
 
-        void on_finished(Job* job) noexcept;            //called when the job finishes, i.e. all children have finished
+        void on_finished(Job* job) noexcept;            //called when the job finishes, i.e. all children have finished
+
+        /**
+        * \brief Child tells its parent that it has finished.
+        *
+        * A child that finished calls this function for its parent, thus decreasing
+        * the number of left children by one. If the last one finishes (including the
+        * parent itself) then the parent also finishes (and may call its own parent).
+        * Note that a Job is also its own child, so it must have returned from
+        * its function before on_finished() is called. Note that a Job is also its own
+        * child so that the Job can only finish after its function has returned.
+        *
+        * \param[in] job The parent.
+        * \param[in] num_children Number of children that finished, more than 1 if a group reports at once.
+        * \returns true if this was the last child.
+        */
+        inline bool child_finished(Job_base* job, uint32_t num_children = 1) noexcept {
+            uint32_t num = job->m_children.fetch_sub(num_children);     //less children
+            if (num == num_children) {                                  //were these the last children?
+
+                if (job->is_function()) {            //Jobs call always on_finished()
+                    on_finished((Job*)job);     //if yes then finish this job
+                }
+                else {
+                    schedule_placed(job);   //a coro just gets scheduled again so it can go on
+                }
+                return true;
+            }
+            return false;
+        }
+
+        /**
+        * \brief Choose the CPUs for the worker threads.
+        *
+        * CPUs are sorted by NUMA node, L3 domain and core, so that neighboring threads share caches.
+        * The first hardware thread of each core comes first, SMT siblings are used only if there
+        * are more threads than cores.
+        *
+        * \param[in] affinity Contains the CPUs that must not be used.
+        * \returns the CPUs to use, empty if the topology is unknown.
+        */
+        std::vector<cpu_t> place_threads(const affinity_t& affinity) {
+            std::vector<cpu_t> cpus = get_cpu_topology();
+            std::erase_if(cpus, [&](const cpu_t& cpu) {
+                return std::find(affinity.m_reserved_cpus.begin(), affinity.m_reserved_cpus.end(), cpu.m_cpu) != affinity.m_reserved_cpus.end();
+            });
+
+            std::vector<cpu_t> primary, secondary;
+            std::sort(cpus.begin(), cpus.end(), [](const cpu_t& a, const cpu_t& b) {
+                return std::tie(a.m_node, a.m_l3, a.m_core, a.m_cpu) < std::tie(b.m_node, b.m_l3, b.m_core, b.m_cpu);
+            });
+            for (uint32_t i = 0; i < cpus.size(); ++i) {
+                bool sibling = i > 0 && cpus[i].m_core >= 0 && cpus[i].m_core == cpus[i - 1].m_core;
+                (sibling ? secondary : primary).push_back(cpus[i]);
+            }
+            primary.insert(primary.end(), secondary.begin(), secondary.end());
+            return primary;
+        }
+
+        /**
+        * \brief For each thread, sort the other threads by distance of their CPUs.
+        *
+        * Threads at the same distance are ordered starting after the own index, so that thieves spread out.
+        * If threads are not pinned, all threads have the same distance.
+        */
+        void compute_steal_order() {
+            m_steal_order.assign(m_thread_count, {});
+            for (uint32_t i = 0; i < m_thread_count; ++i) {
+                auto& order = m_steal_order[i];
+                for (uint32_t j = 1; j < m_thread_count; ++j) {
+                    order.push_back((i + j) % m_thread_count);
+                }
+                if (m_worker_cpus.empty()) continue;
+                const cpu_t& cpu = m_worker_cpus[i % m_worker_cpus.size()];
+                std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                    return cpu.distance(m_worker_cpus[a % m_worker_cpus.size()]) < cpu.distance(m_worker_cpus[b % m_worker_cpus.size()]);
+                });
+            }
+        }
+
+        /**
+        * \brief Wake up a thread if it is parked.
+        * \param[in] thread_index The thread that has new work in one of its queues.
+        * \returns true if the thread was parked, else false.
+        */
+        bool wake_up(thread_index_t thread_index) noexcept {
+            std::atomic_thread_fence(std::memory_order::seq_cst);   //the new job must be visible before reading the flag
+            auto& sleeping = m_sleeping[thread_index.value]->m_value;
+            if (!sleeping.load(std::memory_order::relaxed)) return false;   //awake, no syscall needed
+            {
+                std::lock_guard<std::mutex> lk(*m_mutex[thread_index.value]);
+                sleeping = false;
+            }
+            m_cv[thread_index.value]->notify_one();
+            return true;
+        }
+
+        /**
+        * \brief Wake up one parked thread, so that it can steal work that was queued for a busy thread.
+        */
+        void wake_idle_thief() noexcept {
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            if (m_num_sleeping.load(std::memory_order::relaxed) == 0) return;
+            thread_local static uint32_t next = 0;
+            uint32_t count = (uint32_t)m_sleeping.size();
+            for (uint32_t i = 0; i < count; ++i) {
+                if (++next >= count) next = 0;
+                if (m_sleeping[next]->m_value.load(std::memory_order::relaxed) && wake_up(thread_index_t(next))) return;
+            }
+        }
+
+        /**
+        * \brief Work was put into a queue of a thread. Wake it up if parked, else wake up a thief.
+        * \param[in] thread_index The thread that has new work in its queue.
+        */
+        void wake_up_or_thief(thread_index_t thread_index) noexcept {
+            if (!wake_up(thread_index)) {
+                wake_idle_thief();
+            }
+        }
+
+        /**
+        * \brief Get the queue level of a job.
+        * \param[in] job The job.
+        * \returns the priority of the job, limited to the existing levels.
+        */
+        static uint32_t priority_level(Job_base* job) noexcept {
+            return (uint32_t)std::clamp(job->m_priority.value, 0, (int)c_num_priorities - 1);
+        }
+
+        /**
+        * \brief Test whether there is work in any queue of a thread.
+        * \param[in] idx The thread index.
+        * \returns true if any queue of the thread is not empty.
+        */
+        bool has_work(uint32_t idx) noexcept {
+            for (uint32_t p = 0; p < c_num_priorities; ++p) {
+                if (m_local_queues[p][idx].size() > 0 || m_global_queues[p][idx].size() > 0 || m_deadline_queues[p][idx]->size() > 0) return true;
+            }
+            return m_deques[idx]->size() > 0;
+        }
+
+        /**
+        * \brief Find a job of a given priority, first in the own queues, then by stealing.
+        * \param[in] p The priority level.
+        * \param[in] steal_order The other threads, in the order they are tried.
+        * \param[in] first Index into steal_order where to start.
+        * \returns a job or nullptr.
+        */
+        Job_base* find_job(uint32_t p, const std::vector<uint32_t>& steal_order, uint32_t first) noexcept {
+            auto idx = m_thread_index.value;
+            Job_base* job = m_local_queues[p][idx].pop();               //try get a job from the local queue
+            if (job == nullptr) {
+                job = m_deadline_queues[p][idx]->pop();                 //jobs with deadlines come before the others
+            }
+            if (job == nullptr && p == (uint32_t)priority_normal.value) {
+                job = m_deques[idx]->pop();                             //try get a job from the own deque
+            }
+            if (job == nullptr) {
+                job = m_global_queues[p][idx].pop();                    //try get a job from the global queue
+            }
+            if (job != nullptr || steal_order.empty()) return job;
+
+            for (uint32_t k = 0; job == nullptr && k < steal_order.size(); ++k) {  //try steal job from another thread
+                uint32_t victim = steal_order[(first + k) % steal_order.size()];
+                job = m_deadline_queues[p][victim]->pop();
+                if (job == nullptr && p == (uint32_t)priority_normal.value) {
+                    job = m_deques[victim]->steal();
+                }
+                if (job == nullptr) {
+                    job = m_global_queues[p][victim].pop();
+                }
+            }
+            if (job != nullptr) thread_metrics_t::add(m_metrics[idx]->m_steals);   //failed rounds are counted by the caller
+            return job;
+        }
+
+        /**
+        * \brief Park the current thread until work arrives, the system terminates, or a timeout.
+        * \param[in] timeout Max time to sleep.
+        */
+        void park(std::chrono::microseconds timeout) noexcept {
+            auto idx = m_thread_index.value;
+            auto& sleeping = m_sleeping[idx]->m_value;
+            std::unique_lock<std::mutex> lk(*m_mutex[idx]);
+            sleeping = true;
+            m_num_sleeping++;
+            std::atomic_thread_fence(std::memory_order::seq_cst);   //set the flag before looking into the queues
+            if (!has_work(idx) && !m_terminate) {
+                uint64_t t1 = trace_nanoseconds();
+                m_cv[idx]->wait_for(lk, timeout, [&]() { return !sleeping.load() || m_terminate; });
+                auto& metrics = *m_metrics[idx];
+                thread_metrics_t::add(metrics.m_parks);
+                thread_metrics_t::add(metrics.m_parked_ns, trace_nanoseconds() - t1);
+            }
+            sleeping = false;
+            m_num_sleeping--;
+        }
+
+        /**
+        * \brief A thread enters the job system. Waits until all threads have entered.
+        * \param[in] threadIndex Number of this thread.
+        */
+        void enter(thread_index_t threadIndex) noexcept {
+            if (m_thread_index == threadIndex) return;                     //already entered in run_until()
+            m_thread_index = threadIndex;	                                //Remember your own thread index number
+
+            if (!m_worker_cpus.empty()) {
+                pin_current_thread(m_worker_cpus[threadIndex.value % m_worker_cpus.size()].m_cpu);
+            }
+            const auto& steal_order = m_steal_order[threadIndex.value];
+            m_next_victim = steal_order.empty() ? 0 : rand() % steal_order.size();  //start stealing at a random position
+
+            m_threads_to_start--;			                                //count down
+            while (m_threads_to_start.load() > 0) {}	                    //Continue only if all threads are running
+        }
+
+        /**
+        * \brief If the calling thread is not a worker thread, let it take a reserved thread index.
+        * \returns true if the calling thread is now part of the job system.
+        */
+        bool join_reserved() noexcept {
+            if (m_thread_index.value >= 0) return true;
+            if (m_next_reserved.load() >= m_start_idx.value) return false;  //no reserved index left
+            int idx = m_next_reserved.fetch_add(1);
+            if (idx >= m_start_idx.value) return false;
+            enter(thread_index_t(idx));
+            m_adopted = true;
+            return true;
+        }
+
+        /**
+        * \brief A thread leaves the job system. The last thread destroys all pending jobs and gives back all memory.
+        */
+        void leave() noexcept {
+           //std::cout << "Thread " << m_thread_index.value << " left " << m_thread_count.load() << "\n";
+
+           uint32_t num = m_thread_count.fetch_sub(1);  //last thread gives all Jobs back to the memory resource
+
+           if (num == 1) {         //no other thread runs jobs now, so pending work can be cancelled deterministically
+               for (auto& deque : m_deques) {
+                   deque->clear();                  //destroy pending Jobs and coros
+               }
+               for (uint32_t p = 0; p < c_num_priorities; ++p) {
+                   for (auto& queue : m_global_queues[p]) queue.clear();
+                   for (auto& queue : m_local_queues[p]) queue.clear();
+                   for (auto& queue : m_deadline_queues[p]) queue->clear();
+               }
+               m_tag_queues.clear();                //also jobs waiting for a tag
+               for (auto& pool : m_pools) {
+                   pool->release();
+               }
+               for (auto& arena : m_arenas) {
+                   arena->release();
+               }
+               if constexpr (c_enable_logging) {
+                   if (m_logging) {         //dump trace file
+                       save_log_file();
+                   }
+               }
+               //std::cout << "Last thread " << m_thread_index << " terminated\n";
+               m_terminated = true;
+               m_terminated.notify_all();   //wake up threads in wait_for_termination()
+           }
+        }
+
+        /**
+        * \brief Find the next job for the current thread and run it.
+        *
+        * Higher priorities are tried first, but every c_background_interval jobs background work
+        * is tried first, so that it does not starve. Can be called from inside a job, then the
+        * job is run nested and the current job is restored afterwards.
+        *
+        * \returns true if a job was run, else false.
+        */
+        bool run_next_job() noexcept {
+            const auto idx = m_thread_index.value;
+            const auto& steal_order = m_steal_order[idx];                  //other threads, closest first
+            const uint32_t first = m_worker_cpus.empty() ? m_next_victim : 0; //pinned threads always try the closest first
+            Job_base* job = nullptr;
+
+            if (m_since_background >= c_background_interval) {            //do not let background work starve
+                job = find_job(priority_background.value, steal_order, first);
+                m_since_background = 0;
+            }
+            for (uint32_t p = 0; job == nullptr && p < c_num_priorities; ++p) {   //higher priorities first
+                job = find_job(p, steal_order, first);
+                if (job != nullptr) {
+                    m_since_background = (p == (uint32_t)priority_background.value) ? 0 : m_since_background + 1;
+                }
+            }
+            if (m_worker_cpus.empty() && !steal_order.empty() && ++m_next_victim >= steal_order.size()) m_next_victim = 0;
+            if (job == nullptr) {
+                if (!steal_order.empty()) thread_metrics_t::add(m_metrics[idx]->m_failed_steals);  //once per round over all priorities
+                return false;
+            }
+
+            Job_base* outer = m_current_job;                 //not nullptr if called from inside a job
+            m_current_job = job;
+            thread_type_t type = job->m_type;                //save certain info since a coro might be destroyed
+            thread_id_t id = job->m_id;
+            auto is_function = job->is_function();
+            if (is_function && job->m_token != nullptr && job->m_token->cancelled()) {
+                thread_metrics_t::add(m_metrics[idx]->m_cancelled);
+                child_finished((Job*)job);  //skip the function, but finish it so that the parent is notified
+                m_current_job = outer;
+                return true;
+            }
+            if (job->m_optional && is_function && defer(job)) {     //frame budget nearly spent
+                m_current_job = outer;
+                return true;
+            }
+            uint64_t deadline = job->m_deadline;
+            if constexpr (c_enable_metrics || c_enable_logging) {
+                uint64_t t1 = trace_ticks();	                //time of starting
 
-        /**
-        * \brief Child tells its parent that it has finished.
-        *
-        * A child that finished calls this function for its parent, thus decreasing
-        * the number of left children by one. If the last one finishes (including the
-        * parent itself) then the parent also finishes (and may call its own parent).
-        * Note that a Job is also its own child, so it must have returned from
-        * its function before on_finished() is called. Note that a Job is also its own
-        * child so that the Job can only finish after its function has returned.
-        */
-        inline bool child_finished(Job_base* job) noexcept {
-            uint32_t num = job->m_children.fetch_sub(1);        //one less child
-            if (num == 1) {                                     //was it the last child?
+                (*job)();   //execute the job - a coro might be destroyed here!
 
-                if (job->is_function()) {            //Jobs call always on_finished()
-                    on_finished((Job*)job);     //if yes then finish this job
-                }
-                else {
-                    schedule_job(job);   //a coro just gets scheduled again so it can go on
+                uint64_t t2 = trace_ticks();                 //time of finishing
+                m_metrics[idx]->job_executed(type, t2 - t1);
+                if constexpr (c_enable_logging) {
+                    if (m_logging.load(std::memory_order::relaxed)) {
+                        m_traces[idx]->record(t1, t2, type, id);
+                    }
                 }
-                return true;
             }
-            return false;
+            else {
+                (*job)();   //no instrumentation at all
+            }
+
+            if (is_function) {
+                count_deadline_miss(deadline, type);    //coros are counted when they finish, not on every resume
+            }
+
+            if (is_function) {
+                child_finished((Job*)job);  //a job always finishes itself, a coro will deal with this itself
+            }
+            m_current_job = outer;
+            return true;
         }
 
         /**
@@ -555,97 +2187,102 @@ namespace vgjs {
         * \param[in] threadIndex Number of this thread
         */
         void thread_task(thread_index_t threadIndex = thread_index_t(0) ) noexcept {
-            constexpr uint32_t NOOP = 1<<5;                                   //number of empty loops until garbage collection
-            thread_local static uint32_t noop_counter = 0;
-            m_thread_index = threadIndex;	                                //Remember your own thread index number
-            static std::atomic<uint32_t> thread_counter = m_thread_count.load();	//Counted down when started
+            uint32_t noop_counter = 0;
+            idle_policy_t policy = get_idle_policy();
+            enter(threadIndex);
+            m_adopted = false;                          //from now on this function leaves the system
 
-            thread_counter--;			                                    //count down
-            while (thread_counter.load() > 0) {}	                        //Continue only if all threads are running
-
-            uint32_t next = rand() % m_thread_count;                        //initialize at random position for stealing
-            auto start = high_resolution_clock::now();
-            while (!m_terminate) {			                                //Run until the job system is terminated
-                m_current_job = m_local_queues[m_thread_index.value].pop();       //try get a job from the local queue
-                if (m_current_job == nullptr) {
-                    m_current_job = m_global_queues[m_thread_index.value].pop();  //try get a job from the global queue
+            while (!m_terminate) {			            //Run until the job system is terminated
+                if (run_next_job()) {
+                    noop_counter = 0;
                 }
-                int num_try = m_thread_count - 1;
-                while (m_current_job == nullptr && --num_try >0) {                             //try steal job from another thread
-                    if (++next >= m_thread_count) next = 0;
-                    m_current_job = m_global_queues[next].pop();
+                else if (++noop_counter <= policy.m_spin) {     //spin for a while
+                    cpu_pause();
                 }
-
-                if (m_current_job != nullptr) {
-                    std::chrono::high_resolution_clock::time_point t1, t2;	///< execution start and end
-                    thread_type_t type;
-                    thread_id_t id;
-
-                    if constexpr (c_enable_logging) {
-                        if (is_logging()) {
-                            t1 = std::chrono::high_resolution_clock::now();	//time of finishing;
-                        }
-                        type = m_current_job->m_type;
-                        id = m_current_job->m_id;
-                    }
-                    auto is_function = m_current_job->is_function();      //save certain info since a coro might be destroyed
-
-                    (*m_current_job)();   //if any job found execute it - a coro might be destroyed here!
-
-                    if constexpr (c_enable_logging) {
-                        if (is_logging()) {
-                            t2 = std::chrono::high_resolution_clock::now();	//time of finishing
-                            log_data(t1, t2, m_thread_index, false, type, id);
-                        }
-                    }
-
-                    if (is_function) {
-                        child_finished((Job*)m_current_job);  //a job always finishes itself, a coro will deal with this itself
-                    }
-                    noop_counter = 0;
+                else if (noop_counter <= policy.m_spin + policy.m_yield) {  //then give others the core
+                    std::this_thread::yield();
                 }
-                else if (++noop_counter > NOOP) {   //if none found too longs let thread sleep
-                    m_delete.clear();       //delete jobs to reclaim memory
-                    std::unique_lock<std::mutex> lk(*m_mutex[m_thread_index.value]);
-                    m_cv[m_thread_index.value]->wait_for(lk, std::chrono::microseconds(100));
-                    noop_counter = noop_counter / 2;
+                else {                              //if none found too long let thread sleep
+                    park(policy.m_park);
+                    policy = get_idle_policy();
+                    noop_counter = 0;
                 }
             };
 
-           //std::cout << "Thread " << m_thread_index.value << " left " << m_thread_count.load() << "\n";
+            leave();
+        };
 
-           m_global_queues[m_thread_index.value].clear(); //clear your global queue
-           m_local_queues[m_thread_index.value].clear();  //clear your local queue
+        /**
+        * \brief Run jobs on the calling thread until a condition is met.
+        *
+        * Worker threads, also from inside a job, run queued jobs (own queues first, then stealing)
+        * while waiting. If the job system was created with start_idx > 0, a thread that is not a
+        * worker thread, e.g. the main thread, takes the next reserved thread index on its first call
+        * and from then on runs the jobs of this thread. Such a thread leaves the job system if
+        * run_until() or wait_for_termination() returns after the system was terminated.
+        * Other threads cannot run jobs and only wait.
+        *
+        * The calling thread does not park, since nobody could wake it up if the condition changes.
+        *
+        * \param[in] predicate Callable that returns true if the wait is over.
+        * \returns true if the condition is met, false if the system was terminated.
+        */
+        template<typename P>
+        bool run_until(P&& predicate) noexcept {
+            uint32_t noop_counter = 0;
+            idle_policy_t policy = get_idle_policy();
+            bool is_worker = join_reserved();
+            bool result = true;
+
+            while (!predicate()) {
+                if (m_terminate) {
+                    result = false;
+                    break;
+                }
+                if (is_worker && run_next_job()) {
+                    noop_counter = 0;
+                }
+                else if (++noop_counter <= policy.m_spin) {     //spin for a while
+                    cpu_pause();
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
 
-           uint32_t num = m_thread_count.fetch_sub(1);  //last thread clears recycle and garbage queues
-           m_recycle.clear();
-           m_delete.clear();
+            if (m_terminate && m_adopted) {                 //a reserved thread leaves the system
+                m_adopted = false;
+                leave();
+                m_thread_index = thread_index_t{};
+            }
+            return result;
+        }
 
-           if (num == 1) {
-               if constexpr (c_enable_logging) {
-                   if (m_logging) {         //dump trace file
-                       save_log_file();
-                   }
-               }
-               //std::cout << "Last thread " << m_thread_index << " terminated\n";
-               m_terminated = true;
-           }
-        };
+        /**
+        * \brief Run at most one queued job on the calling thread, e.g. inside a custom wait loop.
+        * \returns true if a job was run, else false.
+        */
+        bool help_while_waiting() noexcept {
+            return !m_terminate && join_reserved() && run_next_job();
+        }
 
         /**
         * \brief An old Job can be recycled. 
         * 
-        * There is one recycle queue that can store old Jobs. 
-        * If it is full then put the Job to the delete queue.
+        * The Job is returned to the pool it was allocated from. If this is the pool of the
+        * current thread this is a plain list push, else the Job is pushed to the lock-free
+        * return list of the owning pool.
         * 
         * \param[in] job Pointer to the finished Job.
         */
         void recycle(Job* job) noexcept {
-            if (m_recycle.size() <= c_queue_capacity) {
-                m_recycle.push(job);        //save it so it can be reused later
+            job->m_function.reset();        //release the captured state now
+            JobPool* pool = job->m_pool;
+            if (pool == get_pool() && pool != m_pools.back().get()) {
+                pool->free(job);            //own pool
             }
             else {
-                m_delete.push(job);   //push to delete queue
+                pool->free_remote(job);     //return to the owner
             }
         }
 
@@ -654,20 +2291,61 @@ namespace vgjs {
         */
         void terminate() noexcept {
             m_terminate = true;
+            for (uint32_t i = 0; i < m_sleeping.size(); ++i) {
+                wake_up(thread_index_t(i));     //parked threads leave now
+            }
+        }
+
+        /**
+        * \brief Set how threads behave if they do not find any work.
+        * \param[in] policy The new idle policy, used by each thread the next time it parks.
+        */
+        void set_idle_policy(idle_policy_t policy) noexcept {
+            std::lock_guard<std::mutex> lk(m_idle_policy_mutex);
+            m_idle_policy = policy;
+        }
+
+        /**
+        * \returns the current idle policy.
+        */
+        idle_policy_t get_idle_policy() noexcept {
+            std::lock_guard<std::mutex> lk(m_idle_policy_mutex);
+            return m_idle_policy;
         }
 
         /**
         * \brief Wait for termination of all jobs.
         *
         * Can be called by the main thread to wait for all threads to terminate.
-        * Returns as soon as all threads have exited.
+        * Returns as soon as all threads have exited. A thread outside the job system also joins
+        * the threads, after this a new JobSystem can be created, e.g. with a different number of threads.
         */
         void wait_for_termination() noexcept {
-            while (m_terminated.load() == false) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (m_adopted) {
+                run_until([]() { return false; });  //a reserved thread runs its jobs until termination, then leaves
+            }
+            m_terminated.wait(false);       //sleep until the last thread has exited
+            if (m_thread_index.value >= 0) return;  //a worker cannot join the other threads
+
+            std::lock_guard<std::mutex> lock(m_init_mutex);
+            if (!m_terminated) return;      //a new system has been started meanwhile
+            for (auto& thread : m_threads) {
+                if (thread.joinable()) thread.join();
             }
+            m_threads.clear();
+            m_restartable = true;           //the next explicit constructor call starts a new system
         };
 
+        /**
+        * \brief Get the next thread in round robin order for placing jobs without a target thread.
+        * \returns the index of the next thread.
+        */
+        thread_index_t next_thread_index() noexcept {
+            thread_local static thread_index_t thread_index(rand() % m_thread_count);
+            thread_index.value = (thread_index.value + 1) >= (int)m_thread_count ? 0 : thread_index.value + 1;
+            return thread_index;
+        }
+
         /**
         * \brief Get a pointer to the current job.
         * \returns a pointer to the current job.
@@ -676,6 +2354,26 @@ namespace vgjs {
             return m_current_job;
         }
 
+        /**
+        * \brief A coro resumes its parent directly on this thread, which then is the current job.
+        * \param[in] job The job that is resumed.
+        */
+        static void set_current_job(Job_base* job) noexcept {
+            m_current_job = job;
+        }
+
+        /**
+        * \brief Test whether a job may run on the current thread right now.
+        * \param[in] job The job.
+        * \returns true if this is a worker thread and the job either has no thread index or the index of this thread,
+        * and its placement hint, if any, names this thread.
+        */
+        bool can_run_here(Job_base* job) noexcept {
+            if (m_thread_index.value < 0) return false;
+            if (job->m_placement.value >= 0 && job->m_placement.value < (int)m_thread_count && job->m_placement.value != m_thread_index.value) return false;
+            return job->m_thread_index.value < 0 || job->m_thread_index.value >= (int)m_thread_count || job->m_thread_index == m_thread_index;
+        }
+
         /**
         * \brief Get the thread index the current job is running on.
         * \returns the index of the thread the current job is running on, or -1.
@@ -692,6 +2390,15 @@ namespace vgjs {
             return thread_count_t( m_thread_count );
         }
 
+        /**
+        * \brief Get the number of jobs in the work stealing deque of the current thread.
+        * \returns the number of jobs in the deque of the current thread, or 0 if this is not a worker thread.
+        */
+        uint32_t get_deque_size() noexcept {
+            if (m_thread_index.value < 0 || m_thread_index.value >= (int)m_thread_count) return 0;
+            return m_deques[m_thread_index.value]->size();
+        }
+
         /**
         * \brief Get the memory resource used for allocating job structures.
         * \returns the memory resource used for allocating job structures.
@@ -707,28 +2414,155 @@ namespace vgjs {
         * \param[in] job A pointer to the job to schedule.
         */
         uint32_t schedule_job(Job_base* job, tag_t tg = tag_t{}) noexcept {
-            thread_local static thread_index_t thread_index(rand() % m_thread_count);
-
             assert(job!=nullptr);
 
             if ( tg.value >= 0 ) {                  //tagged scheduling
-                if(!m_tag_queues.contains(tg)) {
-                    m_tag_queues[tg] = std::make_unique<JobQueue<Job_base>>();
-                }
-                m_tag_queues.at(tg)->push(job); //save for later
+                m_tag_queues.get(tg)->push(job);    //save for later
                 return 0;
             }
 
+            uint32_t p = priority_level(job);
             if (job->m_thread_index.value < 0 || job->m_thread_index.value >= (int)m_thread_count ) {
-                thread_index.value = (++thread_index.value) >= (decltype(thread_index.value))m_thread_count ? 0 : thread_index.value;
-                m_global_queues[thread_index.value].push(job);
-                m_cv[thread_index.value]->notify_one();                    //wake up the thread
+                thread_index_t thread_index = next_thread_index();
+                if (job->has_deadline()) {              //earliest deadline first, a worker keeps it, others can steal it
+                    bool is_worker = m_thread_index.value >= 0 && m_thread_index.value < (int)m_thread_count;
+                    if (is_worker) thread_index = m_thread_index;
+                    m_deadline_queues[p][thread_index.value]->push(job);
+                    if (is_worker) wake_idle_thief(); else wake_up_or_thief(thread_index);
+                    return 1;
+                }
+                if (p == (uint32_t)priority_normal.value && m_thread_index.value >= 0 && m_thread_index.value < (int)m_thread_count) {
+                    m_deques[m_thread_index.value]->push(job);                //a worker pushes to its own deque, others steal from it
+                    wake_idle_thief();
+                }
+                else {
+                    m_global_queues[p][thread_index.value].push(job);         //other threads and priorities use the global queues
+                    wake_up_or_thief(thread_index);
+                }
+                return 1;
+            }
+
+            m_local_queues[p][job->m_thread_index.value].push(job); //to a specific thread
+            wake_up(job->m_thread_index);
+            return 1;
+        };
+
+        /**
+        * \brief Schedule a continuation or a parent coro whose children have finished.
+        *
+        * Jobs with a thread index or without a placement policy are scheduled as usual.
+        * With placement_last_child the job is put into the local queue of the calling worker,
+        * which just finished the last child and has its data in the caches. The job runs next
+        * and cannot be stolen. A placement >= 0 is a soft hint, the job goes to the global
+        * queue of that thread, where idle threads can still steal it.
+        *
+        * \param[in] job A pointer to the job to schedule.
+        * \returns the number of scheduled jobs.
+        */
+        uint32_t schedule_placed(Job_base* job) noexcept {
+            assert(job != nullptr);
+            bool has_index = job->m_thread_index.value >= 0 && job->m_thread_index.value < (int)m_thread_count;
+            if (has_index || job->m_placement == placement_any) {
+                return schedule_job(job);
+            }
+
+            uint32_t p = priority_level(job);
+            if (job->m_placement == placement_last_child) {
+                if (m_thread_index.value < 0 || m_thread_index.value >= (int)m_thread_count) {
+                    return schedule_job(job);   //not a worker thread, so no caches to reuse
+                }
+                m_local_queues[p][m_thread_index.value].push(job);  //runs next on this thread
                 return 1;
             }
 
-            m_local_queues[job->m_thread_index.value].push(job); //to a specific thread
-            m_cv[job->m_thread_index.value]->notify_one();
+            if (job->m_placement.value < 0 || job->m_placement.value >= (int)m_thread_count) {
+                return schedule_job(job);
+            }
+            thread_index_t thread_index{ job->m_placement.value };
+            m_global_queues[p][thread_index.value].push(job);       //hint, can still be stolen
+            wake_up_or_thief(thread_index);
             return 1;
+        }
+
+
+        /**
+        * \brief Schedule a linked list of jobs into the job system.
+        *
+        * The jobs are linked through m_next, their parents and the children counters of the parents
+        * must have been set already. Jobs with a thread index go to the local queue of that thread,
+        * all other jobs are split into contiguous chunks, one chunk per thread. Each chunk is
+        * linked into the target queue with a single lock, and each target thread is woken up at most once.
+        *
+        * \param[in] head First job of the list.
+        * \param[in] num Number of jobs in the list.
+        * \returns the number of scheduled jobs.
+        */
+        uint32_t schedule_chain(Job_base* head, uint32_t num) noexcept {
+            struct job_chain {
+                Job_base*   m_head = nullptr;
+                Job_base*   m_tail = nullptr;
+                int32_t     m_size = 0;
+
+                void push(Job_base* job) noexcept {
+                    if (m_tail == nullptr) m_head = job; else m_tail->m_next = job;
+                    m_tail = job;
+                    ++m_size;
+                }
+            };
+            thread_local static std::vector<job_chain> local_chains;    //reused, so no allocation in steady state
+            thread_local static std::vector<job_chain> global_chains;
+            local_chains.assign(c_num_priorities * m_thread_count, job_chain{});    //one chain per priority and thread
+            global_chains.assign(c_num_priorities * m_thread_count, job_chain{});
+
+            uint32_t chunk = (num + m_thread_count - 1) / m_thread_count;   //jobs per thread
+            uint32_t in_chunk = 0;
+            thread_index_t target = next_thread_index();
+            uint32_t i = 0;
+
+            for (Job_base* job = head; job != nullptr && i < num; ++i) {    //split the list into chains
+                Job_base* next = (Job_base*)job->m_next;
+                job->m_next = nullptr;
+                uint32_t offset = priority_level(job) * m_thread_count;
+                if (job->m_thread_index.value >= 0 && job->m_thread_index.value < (int)m_thread_count) {
+                    local_chains[offset + job->m_thread_index.value].push(job);     //to a specific thread
+                }
+                else if (job->has_deadline()) {
+                    schedule_job(job);                                      //to a deadline queue
+                }
+                else {
+                    if (in_chunk == chunk) {                                //chunk is full - go to next thread
+                        target.value = (target.value + 1) >= (int)m_thread_count ? 0 : target.value + 1;
+                        in_chunk = 0;
+                    }
+                    global_chains[offset + target.value].push(job);
+                    ++in_chunk;
+                }
+                job = next;
+            }
+
+            for (uint32_t c = 0; c < local_chains.size(); ++c) {             //one splice and at most one wake up per queue
+                uint32_t p = c / m_thread_count;
+                uint32_t t = c % m_thread_count;
+                auto& lc = local_chains[c];
+                auto& gc = global_chains[c];
+                m_local_queues[p][t].push_chain(lc.m_head, lc.m_tail, lc.m_size);
+                if (gc.m_size > 0 && (int)t == m_thread_index.value && p == (uint32_t)priority_normal.value) {
+                    for (Job_base* job = gc.m_head; job != nullptr; ) {    //own chunk goes to the own deque
+                        Job_base* next = (Job_base*)job->m_next;
+                        m_deques[t]->push(job);
+                        job = next;
+                    }
+                    wake_idle_thief();
+                }
+                else if (gc.m_size > 0) {
+                    m_global_queues[p][t].push_chain(gc.m_head, gc.m_tail, gc.m_size);
+                    wake_up_or_thief(thread_index_t(t));
+                }
+                else if (lc.m_size > 0) {
+                    wake_up(thread_index_t(t));                             //only parked threads are notified
+                }
+            }
+            return i;
         };
 
 
@@ -740,27 +2574,22 @@ namespace vgjs {
         * \returns the number of scheduled jobs.
         */
         uint32_t schedule_tag( tag_t& tg, tag_t tg2 = tag_t{}, Job_base* parent = m_current_job, int32_t children = -1) noexcept {
-            if (!m_tag_queues.contains(tg)) return 0;
+            if (tg.value < 0) return 0;
+            JobQueue<Job_base>* queue = m_tag_queues.get(tg, false);   //get the queue for this tag
+            if (queue == nullptr) return 0;
 
-            JobQueue<Job_base>* queue = m_tag_queues[tg].get();   //get the queue for this tag
-            uint32_t num_jobs = queue->size();
+            int32_t num_jobs = 0;
+            Job_base* head = queue->pop_all(num_jobs);     //take all jobs at once, jobs pushed later wait for the next call
 
             if (parent != nullptr) { 
                 if (children < 0) children = num_jobs;     //if the number of children is not given, then use queue size
                 parent->m_children.fetch_add((int)children);    //add this number to the number of children of parent
             }
 
-            uint32_t num = num_jobs;        //schedule at most num_jobs, since someone could add more jobs now
-            int i = 0;
-            while ( num>0 ) {     //schedule all jobs from the tag queue
-                Job_base* job = queue->pop();
-                if (!job) return i;
+            for (Job_base* job = head; job != nullptr; job = (Job_base*)job->m_next) {
                 job->m_parent = parent;
-                schedule_job(job, tag_t{});
-                --num;
-                ++i;
             }
-            return i;
+            return schedule_chain(head, num_jobs);    //schedule them all at once
         };
 
 
@@ -779,6 +2608,7 @@ namespace vgjs {
             }
             else {
                 Job* job = allocate_job(std::forward<F>(function));
+                inherit_token(job, parent);
                 job->m_parent = nullptr;
                 if (tg.value < 0) {
                     job->m_parent = parent;
@@ -792,6 +2622,55 @@ namespace vgjs {
         };
 
 
+        /**
+        * \brief Allocate a Job for a function and set its parent, but do not schedule it yet.
+        * The children counter of the parent is not changed.
+        * \param[in] f The function to put into the Job.
+        * \param[in] parent The parent of this Job.
+        * \returns a pointer to the Job.
+        */
+        template<typename F>
+        requires FUNCTOR<F>
+        Job_base* prepare_job(F&& f, Job_base* parent = m_current_job) noexcept {
+            Job* job = allocate_job(std::forward<F>(f));
+            inherit_token(job, parent);
+            job->m_parent = parent;
+            return job;
+        }
+
+        /**
+        * \brief Allocate a Job that counts the completion of a group of children for their parent.
+        *
+        * The children of a large batch are split into groups, and each group gets such a Job as
+        * parent. A child only decreases the counter of its group, which mostly stays in the cache of
+        * the thread running the group, and the group reports all its children to the real parent at
+        * once. So the counter of the parent is touched once per group instead of once per child.
+        * The Job itself is never run, it finishes when the last child of its group has finished.
+        *
+        * \param[in] parent The real parent of the children.
+        * \param[in] num Number of children in the group.
+        * \returns a pointer to the Job, to be used as parent of the children of the group.
+        */
+        Job_base* allocate_combiner(Job_base* parent, uint32_t num) noexcept {
+            Job* job = allocate_job();
+            job->m_children = num;
+            job->m_combined = num;
+            job->m_parent = parent;
+            job->m_token = parent->m_token;         //the children inherit the token of the real parent
+            return job;
+        }
+
+        /**
+        * \brief A job without own cancel token uses the token of its parent.
+        * \param[in] job The job.
+        * \param[in] parent The parent of the job.
+        */
+        static void inherit_token(Job_base* job, Job_base* parent) noexcept {
+            if (job->m_token == nullptr && parent != nullptr) {
+                job->m_token = parent->m_token;
+            }
+        }
+
         /**
         * \brief Store a continuation for the current Job. Will be scheduled once the current Job finishes.
         * \param[in] f The function to schedule as continuation.
@@ -803,47 +2682,326 @@ namespace vgjs {
             if (current == nullptr || !current->is_function()) {
                 return;
             }
-            ((Job*)current)->m_continuation = allocate_job(std::forward<F>(f));
+            Job* job = allocate_job(std::forward<F>(f));
+            inherit_token(job, current);            //the continuation belongs to the same subtree
+            ((Job*)current)->m_continuation = job;
+        }
+
+        //-----------------------------------------------------------------------------------------
+
+        /**
+        * \brief Get a snapshot of the logging data so it can be saved to file.
+        * \param[in] last Only events of this last time span are returned, or all if 0.
+        * \returns for each thread the recorded events, oldest first.
+        */
+        std::vector<std::vector<trace_event_t>> get_logs(std::chrono::nanoseconds last = std::chrono::nanoseconds(0)) {
+            uint64_t since = 0;
+            if (last.count() > 0) {
+                uint64_t ticks = (uint64_t)(last.count() / ns_per_tick());
+                uint64_t now = trace_ticks();
+                since = now > ticks ? now - ticks : 0;
+            }
+            std::vector<std::vector<trace_event_t>> logs;
+            for (auto& trace : m_traces) {
+                logs.push_back(trace->snapshot(since));
+            }
+            return logs;
+        }
+
+        /**
+        * \brief Clear all logs.
+        */
+        void clear_logs() {
+            for (auto& trace : m_traces) {
+                trace->clear();
+            }
+        }
+
+        /**
+        * \brief Measure how long a tick of trace_ticks() is, by comparing with the steady clock since the start.
+        * \returns the number of nanoseconds per tick.
+        */
+        double ns_per_tick() noexcept {
+            uint64_t ticks = trace_ticks() - m_start_ticks;
+            uint64_t ns = trace_nanoseconds() - m_start_ns;
+            if (ticks == 0 || ns == 0) return 1.0;
+            return (double)ns / (double)ticks;
+        }
+
+        /**
+        * \brief Get the ticks when the job system was started (for logging)
+        * \returns the ticks of the start
+        */
+        uint64_t start_ticks() noexcept {
+            return m_start_ticks;
+        }
+
+        /**
+        * \brief Write the recorded events into a compact binary file. Logging continues.
+        *
+        * Since each thread records into a ring buffer, calling this after an interesting event
+        * (e.g. a frame spike) saves what happened right before. Use convert_trace() to
+        * turn the file into a Chrome trace.
+        *
+        * \param[in] filename Name of the binary file.
+        * \param[in] last Only save events of this last time span, or all if 0.
+        * \returns true if the file was written.
+        */
+        bool dump_trace(const std::string& filename = "trace.bin", std::chrono::nanoseconds last = std::chrono::nanoseconds(0)) {
+            auto logs = get_logs(last);
+            std::ofstream out(filename, std::ios::binary);
+            if (!out) return false;
+
+            trace_header_t header;
+            header.m_num_threads = (uint32_t)logs.size();
+            header.m_ns_per_tick = ns_per_tick();
+            header.m_start_ticks = m_start_ticks;
+            out.write((const char*)&header, sizeof(header));
+
+            uint32_t num_types = (uint32_t)m_types.size();
+            out.write((const char*)&num_types, sizeof(num_types));
+            for (auto& [type, name] : m_types) {
+                uint32_t length = (uint32_t)name.size();
+                out.write((const char*)&type, sizeof(type));
+                out.write((const char*)&length, sizeof(length));
+                out.write(name.data(), length);
+            }
+
+            for (uint32_t i = 0; i < logs.size(); ++i) {
+                uint32_t num = (uint32_t)logs[i].size();
+                out.write((const char*)&i, sizeof(i));
+                out.write((const char*)&num, sizeof(num));
+                out.write((const char*)logs[i].data(), num * sizeof(trace_event_t));
+            }
+            return (bool)out;
+        }
+
+        /**
+        * \brief Enable logging.
+        * If logging is enabled, start/stop times and other data of each thread is saved
+        * in a memory data structure.
+        */
+        void enable_logging() {
+            if constexpr (!c_enable_logging) return;     //compiled without logging
+            m_logging = true;
+        }
+
+        /**
+        * \brief Disable logging.
+        * If logging is enabled, start/stop times and other data of each thread is saved
+        * in a memory data structure.
+        */
+        void disable_logging() {
+            if (m_logging) {
+                save_log_file();
+            }
+            m_logging = false;
+        }
+
+        /**
+        * \brief Get the memory resource for memory that is only needed during the current frame.
+        *
+        * Memory allocated in frame f stays valid until next_frame() has been called twice, i.e.
+        * it can still be used while frame f+1 runs. Deallocating does nothing.
+        *
+        * \returns a pointer to the frame resource.
+        */
+        n_pmr::memory_resource* frame_resource() noexcept {
+            return &m_frame_resource;
+        }
+
+        /**
+        * \brief Start the next frame. From now on the frame resource allocates from the arenas of this frame,
+        * and memory of the frame before the previous one is reused.
+        * \returns the number of the new frame.
+        */
+        uint64_t next_frame() noexcept {
+            {
+                std::lock_guard<std::mutex> lock(m_frame_mutex);
+                uint64_t now = trace_nanoseconds();
+                std::array<uint64_t, thread_metrics_t::c_num_types + 2> counts{};   //misses per type, then deferred jobs
+                for (auto& metrics : m_metrics) {
+                    for (uint32_t t = 0; t <= thread_metrics_t::c_num_types; ++t) counts[t] += metrics->m_missed[t].load(std::memory_order::relaxed);
+                    counts.back() += metrics->m_deferred.load(std::memory_order::relaxed);
+                }
+
+                frame_report_t report;              //report for the frame that ends now
+                report.m_frame = m_frame.load(std::memory_order::acquire);
+                report.m_duration = std::chrono::nanoseconds(now - m_frame_start.load());
+                report.m_overrun = m_frame_length > 0 && (uint64_t)report.m_duration.count() > m_frame_length;
+                report.m_deferred = counts.back() - m_frame_counts.back();
+                for (uint32_t t = 0; t <= thread_metrics_t::c_num_types; ++t) {
+                    if (counts[t] > m_frame_counts[t]) {
+                        report.m_missed.emplace_back(t < thread_metrics_t::c_num_types ? thread_type_t{ (int)t } : thread_type_t{}, counts[t] - m_frame_counts[t]);
+                    }
+                }
+                m_frame_report = std::move(report);
+                m_frame_counts = counts;
+
+                m_frame_start = now;                //the new frame starts
+                update_frame_budget();
+            }
+            return m_frame.fetch_add(1, std::memory_order::acq_rel) + 1;
+        }
+
+        /**
+        * \brief Set the frame the scheduler plans for.
+        *
+        * A frame starts with next_frame(). Jobs with a deadline in their budget_t run before other jobs of the
+        * same priority, earliest deadline first. Once less than m_reserve is left of the frame, optional Functions
+        * are not run but put into the tag m_defer_tag, which should be scheduled in the next frame. The parent of
+        * a deferred Function does not wait for it. Setting m_budget to 0 turns deferral off.
+        *
+        * \param[in] budget The frame budget.
+        */
+        void set_frame_budget(const frame_budget_t& budget) noexcept {
+            std::lock_guard<std::mutex> lock(m_frame_mutex);
+            m_frame_budget = budget;
+            update_frame_budget();
+        }
+
+        /**
+        * \brief Get the deadline misses and deferred jobs of the last finished frame, counted by job type.
+        * \returns the report of the frame that was finished by the last call to next_frame().
+        */
+        frame_report_t get_frame_report() noexcept {
+            std::lock_guard<std::mutex> lock(m_frame_mutex);
+            return m_frame_report;
+        }
+
+        /**
+        * \brief Compute the absolute deadline of a job that is scheduled now.
+        * \param[in] budget The budget of the job.
+        * \returns the deadline in ns of trace_nanoseconds().
+        */
+        uint64_t deadline(const budget_t& budget) noexcept {
+            if (budget.m_deadline.count() < 0) return Job_base::c_no_deadline;
+            return m_frame_start.load(std::memory_order::relaxed) + (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(budget.m_deadline).count();
+        }
+
+        /**
+        * \brief Count a job that has finished after its deadline. Jobs finishing outside of the workers are not counted.
+        * \param[in] deadline The deadline of the job in ns of trace_nanoseconds().
+        * \param[in] type The type of the job.
+        */
+        void count_deadline_miss(uint64_t deadline, thread_type_t type) noexcept {
+            if (deadline == Job_base::c_no_deadline || trace_nanoseconds() <= deadline) return;
+            if (m_thread_index.value < 0 || m_thread_index.value >= (int)m_thread_count) return;
+            m_metrics[m_thread_index.value]->deadline_missed(type);
         }
 
-        //-----------------------------------------------------------------------------------------
-
         /**
-        * \brief Get the logging data so it can be saved to file.
-        * \returns a reference to the logging data.
+        * \brief Compute when optional jobs are deferred in the current frame. Call with m_frame_mutex locked.
         */
-        auto& get_logs() {
-            return m_logs;
+        void update_frame_budget() noexcept {
+            uint64_t length = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(m_frame_budget.m_budget).count();
+            uint64_t reserve = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(m_frame_budget.m_reserve).count();
+            m_frame_length = length;
+            m_defer_tag = m_frame_budget.m_defer_tag.value;
+            m_defer_after = (length == 0 || m_frame_budget.m_defer_tag.value < 0) ? Job_base::c_no_deadline
+                : m_frame_start.load() + (length > reserve ? length - reserve : 0);
         }
 
         /**
-        * \brief Clear all logs.
+        * \brief Defer an optional Function to the next frame if the frame budget is nearly spent.
+        *
+        * The Function is put into the defer tag and its parent is notified as if it had finished,
+        * so the parent does not wait for it. Its deadline moves on by one frame.
+        *
+        * \param[in] job The Function.
+        * \returns true if the job was deferred.
         */
-        void clear_logs() {
-            for (auto& log : m_logs) {
-                log.clear();
+        bool defer(Job_base* job) noexcept {
+            uint64_t after = m_defer_after.load(std::memory_order::relaxed);
+            if (after == Job_base::c_no_deadline || trace_nanoseconds() < after) return false;
+            tag_t tg{ m_defer_tag.load(std::memory_order::relaxed) };
+            if (tg.value < 0) return false;
+
+            Job_base* parent = job->m_parent;
+            job->m_parent = nullptr;                //the tag gives it a new parent
+            if (job->has_deadline()) job->m_deadline += m_frame_length.load(std::memory_order::relaxed);
+            m_tag_queues.get(tg)->push(job);
+            thread_metrics_t::add(m_metrics[m_thread_index.value]->m_deferred);
+            if (parent != nullptr) {
+                child_finished(parent);             //do not let the parent wait
             }
+            return true;
         }
 
         /**
-        * \brief Enable logging.
-        * If logging is enabled, start/stop times and other data of each thread is saved
-        * in a memory data structure.
+        * \brief Get the number of the current frame.
+        * \returns the number of the current frame.
         */
-        void enable_logging() {
-            m_logging = true;
+        uint64_t get_frame() noexcept {
+            return m_frame.load(std::memory_order::acquire);
         }
 
         /**
-        * \brief Disable logging.
-        * If logging is enabled, start/stop times and other data of each thread is saved
-        * in a memory data structure.
+        * \brief Allocate memory from the arena of the current thread for the current frame.
+        *
+        * Arenas are reset lazily by their owner when they are first used in a new frame.
+        * Threads that are not worker threads share one set of arenas, protected by a lock.
+        *
+        * \param[in] bytes Number of bytes.
+        * \param[in] alignment Alignment of the memory.
+        * \returns a pointer to the memory.
         */
-        void disable_logging() {
-            if (m_logging) {
-                save_log_file();
+        void* frame_allocate(std::size_t bytes, std::size_t alignment) {
+            if (m_arenas.empty()) {
+                std::cout << "Frame resource used without a job system\n";
+                std::terminate();
             }
-            m_logging = false;
+            const uint64_t frame = m_frame.load(std::memory_order::acquire);
+            const uint32_t num_slots = (uint32_t)m_arenas.size() / c_frames_in_flight;
+            const bool shared = !(m_thread_index.value >= 0 && m_thread_index.value + 1 < (int)num_slots);
+            const uint32_t slot = shared ? num_slots - 1 : (uint32_t)m_thread_index.value;
+            FrameArena& arena = *m_arenas[slot * c_frames_in_flight + frame % c_frames_in_flight];
+
+            if (shared) {
+                while (m_arena_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+            }
+            if (arena.frame() != frame) arena.reset(frame);     //first allocation in this frame
+            void* p = arena.allocate(bytes, alignment);
+            if (shared) {
+                m_arena_lock.clear(std::memory_order::release);              //release lock
+            }
+            return p;
+        }
+
+        /**
+        * \brief Take a snapshot of the runtime metrics. Can be called from any thread at any time.
+        *
+        * All counters count from the start of the job system, so the difference of two snapshots
+        * gives the numbers for the time in between.
+        *
+        * \returns the current values of all counters.
+        */
+        metrics_t get_metrics() {
+            metrics_t result;
+            result.m_ns_per_tick = ns_per_tick();
+            for (uint32_t i = 0; i < m_metrics.size(); ++i) {
+                auto& metrics = *m_metrics[i];
+                metrics_t::thread_t t;
+                t.m_jobs = metrics.m_jobs.load(std::memory_order::relaxed);
+                t.m_steals = metrics.m_steals.load(std::memory_order::relaxed);
+                t.m_failed_steals = metrics.m_failed_steals.load(std::memory_order::relaxed);
+                t.m_parks = metrics.m_parks.load(std::memory_order::relaxed);
+                t.m_parked_ns = metrics.m_parked_ns.load(std::memory_order::relaxed);
+                t.m_cancelled = metrics.m_cancelled.load(std::memory_order::relaxed);
+                t.m_pool_hits = m_pools[i]->hits();
+                t.m_pool_misses = m_pools[i]->misses();
+                t.m_queue_high_water = m_deques[i]->high_water();
+                for (uint32_t p = 0; p < c_num_priorities; ++p) {
+                    t.m_queue_high_water = std::max({ t.m_queue_high_water, m_local_queues[p][i].high_water(), m_global_queues[p][i].high_water() });
+                }
+                for (uint32_t type = 0; type < result.m_histograms.size(); ++type) {
+                    for (uint32_t b = 0; b < thread_metrics_t::c_num_buckets; ++b) {
+                        result.m_histograms[type][b] += metrics.m_histograms[type][b].load(std::memory_order::relaxed);
+                    }
+                }
+                result.m_threads.push_back(t);
+            }
+            return result;
         }
 
         /**
@@ -851,7 +3009,8 @@ namespace vgjs {
         * \returns true or false
         */
         bool is_logging() {
-            return m_logging;
+            if constexpr (!c_enable_logging) return false;
+            return m_logging.load(std::memory_order::relaxed);
         }
 
         /**
@@ -894,17 +3053,39 @@ namespace vgjs {
                 job->m_parent->m_children++;
                 job->m_continuation->m_parent = job->m_parent;   //add successor as child to the parent
             }
-            schedule_job(job->m_continuation);    //schedule the successor
+            schedule_placed(job->m_continuation);    //schedule the successor
         }
 
-        if (job->m_parent != nullptr) {		//if there is parent then inform it	
-            child_finished((Job*)job->m_parent);	//if this is the last child job then the parent will also finish
+        if (job->m_parent != nullptr) {		//if there is parent then inform it, a group reports all its children
+            child_finished((Job*)job->m_parent, job->m_combined > 0 ? job->m_combined : 1);	//if this is the last child job then the parent will also finish
         }
 
         recycle(job);       //recycle the Job
     }
 
 
+    /**
+    * \brief Allocate from the frame arena of the calling thread.
+    * \param[in] bytes Number of bytes.
+    * \param[in] alignment Alignment of the memory.
+    * \returns a pointer to the memory.
+    */
+    inline void* FrameResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+        return JobSystem().frame_allocate(bytes, alignment);
+    }
+
+
+    /**
+    * \brief Deallocate a Job instance by giving it back to its pool.
+    * \param[in] job Pointer to the job.
+    */
+    inline void job_deallocator::deallocate(Job_base* job) noexcept {
+        if (job->is_function()) {                   //only Jobs belong to a pool
+            JobSystem().recycle((Job*)job);
+        }
+    }
+
+
     //----------------------------------------------------------------------------------
 
     /**
@@ -915,6 +3096,26 @@ namespace vgjs {
         return (Job_base*)JobSystem::current_job();
     }
 
+    /**
+    * \brief Test whether the current job has been cancelled. Long jobs can call this to stop early.
+    * \returns true if the cancel token of the current job has been cancelled.
+    */
+    inline bool is_cancelled() noexcept {
+        Job_base* job = current_job();
+        return job != nullptr && job->m_token != nullptr && job->m_token->cancelled();
+    }
+
+    /**
+    * \brief Allocate a Job for a function and set its parent, but do not schedule it.
+    * \param[in] f The function to put into the Job.
+    * \param[in] parent The parent of this Job.
+    * \returns a pointer to the Job.
+    */
+    template<typename F>
+    inline Job_base* prepare_job(F&& f, Job_base* parent) noexcept {
+        return JobSystem().prepare_job(std::forward<F>(f), parent);
+    }
+
     /**
     * \brief Schedule functions into the system. T can be a Function, std::function or a task<U>.
     *
@@ -937,6 +3138,41 @@ namespace vgjs {
                 children = (int)functions.size();
             }
             auto ret = children;
+            if (tg.value < 0) {                     //schedule now - as one batch
+                if (parent != nullptr && children > 0) {
+                    parent->m_children.fetch_add((int)children);    //add all children at once
+                }
+                const uint32_t size = (uint32_t)functions.size();
+                const uint32_t group_size = policy_t::c_combine_size;
+                const bool combine = parent != nullptr && group_size > 0 && size > group_size;  //count large batches in groups
+                Job_base* group = parent;
+                uint32_t left = 0;                  //children left in the current group
+                Job_base* head = nullptr;
+                Job_base* tail = nullptr;
+                uint32_t num = 0;
+                for (auto&& f : functions) {        //create jobs and link them, might call the coro version
+                    if (combine) {
+                        if (left == 0) {
+                            left = std::min(group_size, size - num);
+                            group = JobSystem().allocate_combiner(parent, left);
+                        }
+                        --left;
+                    }
+                    Job_base* job;
+                    if constexpr (std::is_lvalue_reference_v<decltype(functions)>) {
+                        job = prepare_job(f, group);
+                    }
+                    else {
+                        job = prepare_job(std::move(f), group);
+                    }
+                    job->m_next = nullptr;
+                    if (tail == nullptr) head = job; else tail->m_next = job;
+                    tail = job;
+                    ++num;
+                }
+                JobSystem().schedule_chain(head, num);
+                return ret;
+            }
             for (auto&& f : functions) { //schedule all elements, use the total number of children for the first call, then 0
                 if constexpr (std::is_lvalue_reference_v<decltype(functions)>) {
                     schedule(f, tg, parent, children); //might call the coro version, so do not call job system here!
@@ -963,6 +3199,404 @@ namespace vgjs {
         JobSystem().continuation(std::forward<F>(f)); // forward to the job system
     };
 
+    /**
+    * \brief Schedule jobs from a thread that is not a worker thread, and block until they have finished.
+    *
+    * The jobs run as children of a root Function, whose continuation wakes up the caller.
+    * The caller sleeps in std::atomic::wait() and does not poll. Must not be called from inside a job,
+    * since this would block a worker thread.
+    *
+    * \param[in] functions The Function, Coro, vector or tuple to schedule.
+    */
+    template<typename F>
+    inline void schedule_and_wait(F&& functions) noexcept {
+        if (current_job() != nullptr) {
+            std::cout << "Error: schedule_and_wait() must not be called from a job\n";
+            std::terminate();
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false); //shared, so it outlives the caller waking up early
+        schedule(Function{ [&functions, done]() {
+            schedule(std::forward<F>(functions));                     //the caller waits, so functions stays alive
+            continuation(Function{ [done]() {
+                done->store(true);
+                done->notify_all();
+            } });
+        } });
+        done->wait(false);
+    }
+
+    /**
+    * \brief Run jobs on the calling thread until a condition is met, see JobSystem::run_until().
+    * \param[in] predicate Callable that returns true if the wait is over.
+    * \returns true if the condition is met, false if the system was terminated.
+    */
+    template<typename P>
+    requires std::predicate<P&>
+    inline bool run_until(P&& predicate) noexcept {
+        return JobSystem().run_until(predicate);
+    }
+
+    /**
+    * \brief Schedule jobs and run jobs on the calling thread until they have finished.
+    *
+    * Unlike schedule_and_wait() this can be called from inside a Function, and the main thread
+    * can do useful work at a sync point if it took a reserved thread index, see JobSystem::run_until().
+    *
+    * \param[in] functions The Function, vector or tuple to schedule.
+    * \returns true if the jobs have finished, false if the system was terminated.
+    */
+    template<typename F>
+    inline bool run_until(F&& functions) noexcept {
+        auto done = std::make_shared<std::atomic<bool>>(false);    //the continuation might still run after we return
+        schedule(Function{ [&functions, done]() {
+            schedule(std::forward<F>(functions));
+            continuation(Function{ [done]() { done->store(true); } });
+        } }, tag_t{}, nullptr);                                     //no parent, a coro calling this must not be resumed
+        return JobSystem().run_until([&]() { return done->load(); });
+    }
+
+    /**
+    * \brief Run at most one queued job on the calling thread.
+    * \returns true if a job was run, else false.
+    */
+    inline bool help_while_waiting() noexcept {
+        return JobSystem().help_while_waiting();
+    }
+
+
+    //----------------------------------------------------------------------------------
+    //data parallel loops
+
+    /**
+    * \brief A half open range [m_begin, m_end) of integers for data parallel loops.
+    */
+    template<typename I = int64_t>
+    requires std::is_integral_v<I>
+    struct range_t {
+        I m_begin{};    ///<first element of the range
+        I m_end{};      ///<one past the last element of the range
+
+        I size() const noexcept { return m_end > m_begin ? m_end - m_begin : 0; }
+    };
+
+    template<typename I>
+    range_t(I, I) -> range_t<I>;
+
+    /**
+    * \brief Job body of parallel_for(), implements lazy binary splitting.
+    *
+    * The range is processed in chunks of m_grain elements. Before a chunk is processed the
+    * deque of the current thread is checked. If it is empty, then other threads have stolen
+    * all previously split work, so the upper half of the remaining range is split off and scheduled
+    * as child. Thus new jobs are only created if there are thieves asking for work.
+    */
+    template<typename I, typename F>
+    struct parallel_for_job {
+        range_t<I>  m_range;        ///<range to process
+        I           m_grain;        ///<number of elements that are processed without splitting
+        F*          m_function;     ///<the loop body, lives in the root job
+
+        /**
+        * \brief Call the loop body for a range, either per element or for the whole range.
+        */
+        void call(range_t<I> range) const {
+            if constexpr (std::is_invocable_v<F&, range_t<I>>) {
+                (*m_function)(range);
+            }
+            else {
+                for (I i = range.m_begin; i < range.m_end; ++i) (*m_function)(i);
+            }
+        }
+
+        void operator() () const {
+            range_t<I> range = m_range;
+            while (range.size() > m_grain) {
+                if (JobSystem().get_deque_size() == 0) {        //anybody took our work - split
+                    I mid = range.m_begin + range.size() / 2;
+                    schedule(Function{ parallel_for_job<I, F>{ range_t<I>{mid, range.m_end}, m_grain, m_function } });
+                    range.m_end = mid;
+                }
+                else {                                          //still work left for thieves - run a chunk
+                    call(range_t<I>{ range.m_begin, (I)(range.m_begin + m_grain) });
+                    range.m_begin += m_grain;
+                }
+            }
+            call(range);
+        }
+    };
+
+    /**
+    * \brief Create a Function that runs a loop body in parallel over a range.
+    *
+    * The range is split recursively on demand (lazy binary splitting). The result is a Function,
+    * so it can be scheduled from a function with schedule(), or awaited with co_await from a Coro.
+    * The Function finishes when the whole range has been processed.
+    *
+    * \param[in] range The range to process.
+    * \param[in] grain Minimum number of elements processed by a job.
+    * \param[in] f Loop body, called either as f(i) for each element i, or as f(range_t<I>) for a sub range.
+    * \returns a Function that processes the range.
+    */
+    template<typename I, typename F>
+    inline Function parallel_for(range_t<I> range, std::type_identity_t<I> grain, F&& f) noexcept {
+        if (grain < 1) grain = 1;
+        return Function{ [=, func = std::forward<F>(f)]() mutable {
+            parallel_for_job<I, std::decay_t<F>>{ range, grain, &func }();     //func lives as long as the root job
+        } };
+    }
+
+
+    /**
+    * \brief View of an SoA array whose start is aligned to ALIGN bytes, known at compile time.
+    *
+    * Accesses go through std::assume_aligned(), so the compiler can vectorize loops over
+    * the array with aligned loads and stores.
+    */
+    template<typename T, std::size_t ALIGN = 64>
+    struct aligned_span_t {
+        T*          m_data = nullptr;   ///<first element, aligned to ALIGN
+        std::size_t m_size = 0;         ///<number of elements
+
+        T* data() const noexcept { return std::assume_aligned<ALIGN>(m_data); }
+        std::size_t size() const noexcept { return m_size; }
+        T& operator[](std::size_t i) const noexcept { return data()[i]; }
+    };
+
+    /**
+    * \brief Create a Function that runs a kernel in parallel over several SoA arrays of the same size.
+    *
+    * The arrays are cut into chunks, and the kernel is called as f(begin, end, arrays...) for each chunk,
+    * where the arrays are passed as aligned_span_t over the whole arrays. Every begin is a multiple of
+    * a step of elements that covers a whole number of ALIGN byte blocks in each array. So if ALIGN is the
+    * cache line size, chunks never share a cache line, and each chunk starts at an aligned
+    * address in every array, which suits SIMD loops. Chunks are split off on demand like in parallel_for().
+    *
+    * \param[in] grain Minimum number of elements processed by a job, rounded up to the step.
+    * \param[in] f Kernel void f(std::size_t begin, std::size_t end, aligned_span_t<Ts, ALIGN>...).
+    * \param[in] arrays The SoA arrays, all of the same size and aligned to ALIGN bytes.
+    * \returns a Function that processes all arrays.
+    */
+    template<std::size_t ALIGN = 64, typename F, typename... Ts, std::size_t... Es>
+    requires (sizeof...(Ts) > 0 && std::is_invocable_v<F&, std::size_t, std::size_t, aligned_span_t<Ts, ALIGN>...>)
+    inline Function parallel_batch(std::size_t grain, F&& f, std::span<Ts, Es>... arrays) noexcept {
+        static_assert(std::has_single_bit(ALIGN), "ALIGN must be a power of 2");
+        constexpr std::size_t step = std::max({ ALIGN / std::gcd(ALIGN, sizeof(Ts))... });   //powers of 2, so the max is their lcm
+
+        std::size_t size = std::get<0>(std::forward_as_tuple(arrays...)).size();
+        if (((arrays.size() != size) || ...)) {
+            std::cout << "parallel_batch(): arrays must have the same size\n";
+            std::terminate();
+        }
+        if (((reinterpret_cast<std::uintptr_t>(arrays.data()) % ALIGN != 0) || ...)) {
+            std::cout << "parallel_batch(): arrays must be aligned to " << ALIGN << " bytes\n";
+            std::terminate();
+        }
+
+        std::size_t blocks = (size + step - 1) / step;
+        return parallel_for(range_t<std::size_t>{ 0, blocks }, std::max<std::size_t>((grain + step - 1) / step, 1)
+            , [=, kernel = std::forward<F>(f)](range_t<std::size_t> r) mutable {
+                kernel(r.m_begin * step, std::min(r.m_end * step, size), aligned_span_t<Ts, ALIGN>{ arrays.data(), size }...);
+            });
+    }
+
+
+    //----------------------------------------------------------------------------------
+
+    class TaskGraph;
+
+    /**
+    * \brief A node of a TaskGraph. Nodes are created once and scheduled again each time the graph runs.
+    *
+    * A node is a Job_base, but not a Job, so the job system never recycles it. Like a Job, a node
+    * waits for the children it schedules before its successors are released.
+    */
+    class TaskGraphNode : public Job_base {
+        friend class TaskGraph;
+
+        TaskGraph*              m_graph = nullptr;          ///<the graph this node belongs to
+        job_function_t          m_function;                 ///<the work of this node
+        uint32_t                m_num_predecessors = 0;     ///<number of nodes that must finish before this node
+        std::atomic<uint32_t>   m_pending = 0;              ///<predecessors not finished in this run
+        uint32_t                m_first_successor = 0;      ///<first successor in the successor array of the graph
+        uint32_t                m_num_successors = 0;       ///<number of successors
+        bool                    m_ran = false;              ///<the function has been called in this run
+
+    public:
+        bool resume() noexcept;
+    };
+
+    /**
+    * \brief A dependency graph of Functions that is declared once and run any number of times.
+    *
+    * Nodes are added with add_node(), and add_edge(a, b) makes b wait for a. The first run compiles the
+    * graph into a flat array of nodes with precomputed dependency counts. Each run then only resets the
+    * counters and schedules the nodes without predecessors, so running the graph does not allocate
+    * memory besides one Job. A graph must not be run again before its previous run has finished,
+    * and the graph must outlive its runs.
+    */
+    class TaskGraph {
+        friend class TaskGraphNode;
+
+        std::vector<Function>                       m_functions;    ///<functions of the declared nodes
+        std::vector<std::pair<uint32_t, uint32_t>>  m_edges;        ///<declared edges (before, after)
+        std::unique_ptr<TaskGraphNode[]>            m_nodes;        ///<compiled nodes
+        uint32_t                                    m_num_nodes = 0;///<number of compiled nodes
+        std::vector<TaskGraphNode*>                 m_successors;   ///<successors of all nodes, ordered by node
+        std::vector<TaskGraphNode*>                 m_roots;        ///<nodes without predecessors
+        std::atomic<uint32_t>                       m_remaining = 0;///<nodes not finished in this run
+        Job_base*                                   m_parent = nullptr; ///<the Job that runs the graph
+
+        /**
+        * \brief A node has finished, so release its successors.
+        * \param[in] node The finished node.
+        */
+        void node_finished(TaskGraphNode* node) noexcept {
+            JobSystem js;
+            for (uint32_t i = 0; i < node->m_num_successors; ++i) {
+                TaskGraphNode* succ = m_successors[node->m_first_successor + i];
+                if (succ->m_pending.fetch_sub(1) == 1) {        //last predecessor
+                    js.schedule_job(succ);
+                }
+            }
+            if (m_remaining.fetch_sub(1) == 1) {                //last node of this run
+                js.child_finished(m_parent);
+            }
+        }
+
+        /**
+        * \brief Reset all counters and schedule the nodes without predecessors as part of the current Job.
+        */
+        void launch() noexcept {
+            if (m_nodes == nullptr) compile();
+            if (m_num_nodes == 0) return;
+
+            for (uint32_t i = 0; i < m_num_nodes; ++i) {
+                m_nodes[i].m_pending = m_nodes[i].m_num_predecessors;
+                m_nodes[i].m_ran = false;
+            }
+            m_remaining = m_num_nodes;
+            m_parent = current_job();
+            m_parent->m_children.fetch_add(1);      //the Job finishes after the last node
+            JobSystem js;
+            for (auto* node : m_roots) {
+                js.schedule_job(node);
+            }
+        }
+
+    public:
+
+        TaskGraph() noexcept = default;
+        TaskGraph(const TaskGraph&) = delete;
+
+        /**
+        * \brief Declare a new node.
+        * \param[in] f The function of the node. Thread index, type and id are used for each run.
+        * \returns the id of the node, used for declaring edges.
+        */
+        template<typename F>
+        uint32_t add_node(F&& f) {
+            m_functions.emplace_back(Function{ std::forward<F>(f) });
+            m_nodes.reset();                        //compile again
+            return (uint32_t)m_functions.size() - 1;
+        }
+
+        /**
+        * \brief Declare that a node must wait for another one.
+        * \param[in] before The node that runs first.
+        * \param[in] after The node that runs after before has finished.
+        */
+        void add_edge(uint32_t before, uint32_t after) {
+            m_edges.emplace_back(before, after);
+            m_nodes.reset();                        //compile again
+        }
+
+        /**
+        * \brief Compile the declared nodes and edges into the flat node array.
+        * Called automatically by the first run after a change.
+        */
+        void compile() {
+            m_num_nodes = (uint32_t)m_functions.size();
+            m_nodes = std::make_unique<TaskGraphNode[]>(m_num_nodes);
+            m_successors.assign(m_edges.size(), nullptr);
+            m_roots.clear();
+
+            for (auto& [before, after] : m_edges) {
+                if (before >= m_num_nodes || after >= m_num_nodes) {
+                    std::cout << "TaskGraph edge " << before << " -> " << after << " refers to an unknown node\n";
+                    std::terminate();
+                }
+                m_nodes[before].m_num_successors++;
+                m_nodes[after].m_num_predecessors++;
+            }
+
+            uint32_t first = 0;
+            for (uint32_t i = 0; i < m_num_nodes; ++i) {
+                TaskGraphNode& node = m_nodes[i];
+                node.m_graph = this;
+                node.m_function = m_functions[i].m_function;
+                node.m_thread_index = m_functions[i].m_thread_index;
+                node.m_type = m_functions[i].m_type;
+                node.m_id = m_functions[i].m_id;
+                node.m_priority = m_functions[i].m_priority;
+                node.m_first_successor = first;
+                first += node.m_num_successors;
+                node.m_num_successors = 0;          //counted again when filling in the successors
+                if (node.m_num_predecessors == 0) m_roots.push_back(&node);
+            }
+            for (auto& [before, after] : m_edges) {
+                TaskGraphNode& node = m_nodes[before];
+                m_successors[node.m_first_successor + node.m_num_successors++] = &m_nodes[after];
+            }
+
+            std::vector<uint32_t> pending(m_num_nodes);      //test for cycles by sorting the graph
+            std::vector<TaskGraphNode*> ready{ m_roots };
+            uint32_t visited = 0;
+            for (uint32_t i = 0; i < m_num_nodes; ++i) pending[i] = m_nodes[i].m_num_predecessors;
+            while (!ready.empty()) {
+                TaskGraphNode* node = ready.back();
+                ready.pop_back();
+                ++visited;
+                for (uint32_t i = 0; i < node->m_num_successors; ++i) {
+                    TaskGraphNode* succ = m_successors[node->m_first_successor + i];
+                    if (--pending[succ - m_nodes.get()] == 0) ready.push_back(succ);
+                }
+            }
+            if (visited != m_num_nodes) {
+                std::cout << "TaskGraph contains a cycle\n";
+                std::terminate();
+            }
+        }
+
+        /**
+        * \brief Create a Function that runs the graph once.
+        *
+        * The Function finishes when all nodes have finished. It can be scheduled from a function
+        * with schedule(), or awaited with co_await from a Coro.
+        *
+        * \returns a Function running the graph.
+        */
+        Function run() noexcept {
+            return Function{ [this]() { launch(); } };
+        }
+    };
+
+    /**
+    * \brief Run the node function. The successors are released once the function and all its children have finished.
+    * \returns true.
+    */
+    inline bool TaskGraphNode::resume() noexcept {
+        if (!m_ran) {
+            m_ran = true;
+            m_children = 1;                         //node is its own child, so it waits for its children
+            m_function();
+            if (m_children.fetch_sub(1) != 1) {    //children still running, the last one schedules the node again
+                return true;
+            }
+        }
+        m_graph->node_finished(this);
+        return true;
+    }
+
 
     //----------------------------------------------------------------------------------
 
@@ -980,6 +3614,14 @@ namespace vgjs {
         JobSystem().wait_for_termination();
     }
 
+    /**
+    * \brief Set how threads behave if they do not find any work.
+    * \param[in] policy The new idle policy.
+    */
+    inline void set_idle_policy(idle_policy_t policy) {
+        JobSystem().set_idle_policy(policy);
+    }
+
     /**
     * \brief Enable logging.
     * If logging is enabled, start/stop times and other data of each thread is saved
@@ -1006,119 +3648,160 @@ namespace vgjs {
     }
 
     /**
-    * \brief Get the logging data so it can be saved to file.
-    * \returns a reference to the logging data.
+    * \brief Get a snapshot of the logging data so it can be saved to file.
+    * \param[in] last Only events of this last time span are returned, or all if 0.
+    * \returns for each thread the recorded events.
     */
-    inline auto& get_logs() {
-        return JobSystem().get_logs();
+    inline auto get_logs(std::chrono::nanoseconds last = std::chrono::nanoseconds(0)) {
+        return JobSystem().get_logs(last);
     }
 
     /**
-    * \brief Clear all logs.
+    * \brief Take a snapshot of the runtime metrics.
+    * \returns the current values of all counters.
     */
-    inline void clear_logs() {
-        JobSystem().clear_logs();
+    inline metrics_t get_metrics() {
+        return JobSystem().get_metrics();
     }
 
     /**
-    * \brief Store a job run in the log data
-    * 
-    * \param[in] t1 Start time of the job.
-    * \param[in] t2 End time of the job.
-    * \param[in] exec_thread Index of the thread that ran the job.
-    * \param[in] finished If true, then the job finished. 
-    * \param[in] type The job type.
-    * \param[in] id A unique ID.
+    * \brief Get the memory resource for memory that is only needed during the current frame.
+    * \returns a pointer to the frame resource.
     */
-    inline void log_data(
-        std::chrono::high_resolution_clock::time_point& t1, std::chrono::high_resolution_clock::time_point& t2,
-        thread_index_t exec_thread, bool finished, thread_type_t type, thread_id_t id) {
+    inline n_pmr::memory_resource* frame_resource() noexcept {
+        return JobSystem().frame_resource();
+    }
 
-        auto& logs = JobSystem().get_logs();
-        logs[JobSystem().get_thread_index().value].emplace_back( t1, t2, JobSystem().get_thread_index(), finished, type, id);
+    /**
+    * \brief Start the next frame, memory of the frame before the previous one is reused.
+    * \returns the number of the new frame.
+    */
+    inline uint64_t next_frame() noexcept {
+        return JobSystem().next_frame();
     }
 
     /**
-    * \brief Store a job run in the log data
-    *
-    * \param[in] out The output stream for the log file.
-    * \param[in] cat Undefined.
-    * \param[in] pid Always 0.
-    * \param[in] tid The thread index that ran the job.
-    * \param[in] ts Start time.
-    * \param[in] dur Duration of the job.
-    * \param[in] ph Always X
-    * \param[in] name Type name of the job.
-    * \param[in] args Indicates wehther the job has finshed.
-    */
-    inline void save_job(   std::ofstream& out
-                            , std::string cat
-                            , uint64_t pid
-                            , uint64_t tid
-                            , uint64_t ts
-                            , int64_t dur
-                            , std::string ph
-                            , std::string name
-                            , std::string args) {
-
-        std::stringstream time;
-        time.precision(15);
-        time << ts / 1.0e3;
-
-        std::stringstream duration;
-        duration.precision(15);
-        duration << dur / 1.0e3;
-
-        out << "{";
-        out << "\"cat\": " << cat << ", ";
-        out << "\"pid\": " << pid << ", ";
-        out << "\"tid\": " << tid << ", ";
-        out << "\"ts\": " << time.str() << ", ";
-        out << "\"dur\": " << duration.str() << ", ";
-        out << "\"ph\": " << ph << ", ";
-        out << "\"name\": " << name << ", ";
-        out << "\"args\": {" << args << "}";
-        out << "}";
+    * \brief Set the frame the scheduler plans for, see JobSystem::set_frame_budget().
+    * \param[in] budget The frame budget.
+    */
+    inline void set_frame_budget(const frame_budget_t& budget) noexcept {
+        JobSystem().set_frame_budget(budget);
     }
 
     /**
-    * \brief Dump all job data into a json log file.
+    * \brief Get the deadline misses and deferred jobs of the last finished frame.
+    * \returns the report of the last finished frame.
     */
-    inline void save_log_file() {
-        auto& logs = JobSystem().get_logs();
-        std::ofstream outdata;
-        outdata.open("log.json");
-        auto& types = JobSystem().types();
+    inline frame_report_t get_frame_report() noexcept {
+        return JobSystem().get_frame_report();
+    }
 
-        if (outdata) {
-            outdata << "{" << std::endl;
-            outdata << "\"traceEvents\": [" << std::endl;
-            bool comma = false;
-            for (uint32_t i = 0; i < logs.size(); ++i) {
-                for (auto& ev : logs[i]) {
-                    if (ev.m_t1 >= JobSystem().start_time() && ev.m_t2 >= ev.m_t1) {
+    /**
+    * \brief Write the recorded events into a compact binary file.
+    * \param[in] filename Name of the binary file.
+    * \param[in] last Only save events of this last time span, or all if 0.
+    * \returns true if the file was written.
+    */
+    inline bool dump_trace(const std::string& filename = "trace.bin", std::chrono::nanoseconds last = std::chrono::nanoseconds(0)) {
+        return JobSystem().dump_trace(filename, last);
+    }
+
+    /**
+    * \brief Clear all logs.
+    */
+    inline void clear_logs() {
+        JobSystem().clear_logs();
+    }
+
+    /**
+    * \brief Write trace events as Chrome trace JSON, which can be loaded into chrome://tracing.
+    *
+    * \param[in] out The output stream for the log file.
+    * \param[in] logs For each thread its events.
+    * \param[in] types Names of the job types.
+    * \param[in] ns_per_tick Nanoseconds per tick.
+    * \param[in] start_ticks Ticks when the job system was started, all times are relative to this.
+    */
+    inline void write_chrome_trace(std::ostream& out, const std::vector<std::vector<trace_event_t>>& logs
+        , const std::map<int32_t, std::string>& types, double ns_per_tick, uint64_t start_ticks) {
+
+        out << "{\n\"traceEvents\": [\n";
+        bool comma = false;
+        char line[256];
+        for (uint32_t i = 0; i < logs.size(); ++i) {
+            for (auto& ev : logs[i]) {
+                if (ev.m_t1 < start_ticks || ev.m_t2 < ev.m_t1) continue;
+
+                auto it = types.find(ev.m_type);
+                const char* name = it != types.end() ? it->second.c_str() : "-";
+                double ts = (ev.m_t1 - start_ticks) * ns_per_tick / 1.0e3;     //microseconds
+                double dur = (ev.m_t2 - ev.m_t1) * ns_per_tick / 1.0e3;
+                int n = std::snprintf(line, sizeof(line)
+                    , "%s{\"cat\": \"cat\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"ph\": \"X\", \"name\": \"%.100s\", \"args\": {\"id\": %d}}"
+                    , comma ? ",\n" : "", i, ts, dur, name, ev.m_id);
+                out.write(line, std::min(n, (int)sizeof(line) - 1));
+                comma = true;
+            }
+        }
+        out << "\n],\n\"displayTimeUnit\": \"ms\"\n}\n";
+    }
 
-                        if (comma) outdata << "," << std::endl;
+    /**
+    * \brief Convert a binary trace file written by dump_trace() into a Chrome trace JSON file.
+    * Can be called offline, without a running job system.
+    * \param[in] in Name of the binary trace file.
+    * \param[in] out Name of the JSON file.
+    * \returns true if the conversion was successful.
+    */
+    inline bool convert_trace(const std::string& in, const std::string& out = "log.json") {
+        std::ifstream input(in, std::ios::binary);
+        if (!input) return false;
+
+        trace_header_t header;
+        input.read((char*)&header, sizeof(header));
+        if (!input || std::string(header.m_magic) != trace_header_t{}.m_magic || header.m_version != trace_header_t{}.m_version) return false;
+
+        std::map<int32_t, std::string> types;
+        uint32_t num_types = 0;
+        input.read((char*)&num_types, sizeof(num_types));
+        for (uint32_t i = 0; i < num_types && input; ++i) {
+            int32_t type = 0;
+            uint32_t length = 0;
+            input.read((char*)&type, sizeof(type));
+            input.read((char*)&length, sizeof(length));
+            std::string name(length, '\0');
+            input.read(name.data(), length);
+            types[type] = name;
+        }
 
-                        auto it = types.find(ev.m_type.value);
-                        std::string name = "-";
-                        if (it != types.end()) name = it->second;
+        std::vector<std::vector<trace_event_t>> logs(header.m_num_threads);
+        for (uint32_t i = 0; i < header.m_num_threads && input; ++i) {
+            uint32_t idx = 0, num = 0;
+            input.read((char*)&idx, sizeof(idx));
+            input.read((char*)&num, sizeof(num));
+            if (!input || idx >= header.m_num_threads) return false;
+            logs[idx].resize(num);
+            input.read((char*)logs[idx].data(), num * sizeof(trace_event_t));
+        }
+        if (!input) return false;
 
-                        save_job(outdata, "\"cat\"", 0, (uint32_t)ev.m_exec_thread.value,
-                            std::chrono::duration_cast<std::chrono::nanoseconds>(ev.m_t1 - JobSystem().start_time()).count(),
-                            std::chrono::duration_cast<std::chrono::nanoseconds>(ev.m_t2 - ev.m_t1).count(),
-                            "\"X\"", "\"" + name + "\"", "\"id\": " + std::to_string(ev.m_id.value));
+        std::ofstream output(out);
+        if (!output) return false;
+        write_chrome_trace(output, logs, types, header.m_ns_per_tick, header.m_start_ticks);
+        return (bool)output;
+    }
 
-                        comma = true;
-                    }
-                }
-            }
-            outdata << "]," << std::endl;
-            outdata << "\"displayTimeUnit\": \"ms\"" << std::endl;
-            outdata << "}" << std::endl;
+    /**
+    * \brief Dump all job data into a json log file.
+    */
+    inline void save_log_file() {
+        JobSystem js;
+        std::ofstream outdata("log.json");
+        if (outdata) {
+            write_chrome_trace(outdata, js.get_logs(), js.types(), js.ns_per_tick(), js.start_ticks());
         }
         outdata.close();
-        JobSystem().clear_logs();
+        js.clear_logs();
     }
 
 }
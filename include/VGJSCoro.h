@@ -19,6 +19,10 @@
 #include <algorithm>
 #include <assert.h>
 #include <utility>
+#include <span>
+#include <vector>
+#include <memory>
+#include <tuple>
 
 
 
@@ -35,6 +39,8 @@ namespace vgjs {
     template<typename PT, typename... Ts> struct awaitable_tuple;
     template<typename PT> struct awaitable_resume_on; //change the thread
     template<typename PT> struct awaitable_tag; //schedule all jobs for a tag
+    struct awaitable_cancel_check;              //test the cancel token
+    struct awaitable_external;                  //base of awaitables defined elsewhere, e.g. I/O
     template<typename U> struct yield_awaiter;  //co_yield
     template<typename U> struct final_awaiter;  //final_suspend
 
@@ -43,6 +49,8 @@ namespace vgjs {
     template<typename T> class Coro_promise;    //main promise class for all Ts
     template<> class Coro_promise<void>;        //specializiation for T = void
 
+    n_exp::coroutine_handle<> notify_parent(Job_base* parent, bool is_parent_function) noexcept;  //a child coro has finished or yielded
+
     //coroutine future classes
     class Coro_base;                    //common base class independent of return type T
     template<typename T> class Coro;    //main promise class for all Ts
@@ -55,6 +63,38 @@ namespace vgjs {
     template<typename T>
     concept CORO = std::is_base_of_v<Coro_base, std::decay_t<T> >; //resolve only for coroutines
 
+    template<typename T>
+    concept EXTERNAL_AWAITABLE = std::is_base_of_v<awaitable_external, std::decay_t<T> >; //passed on unchanged by co_await
+
+    /**
+    * \brief A vector of coros whose results are written into a caller provided buffer, see collect().
+    */
+    template<typename T>
+    struct result_span_t {
+        n_pmr::vector<Coro<T>>& m_coros;    ///<the coros to run
+        std::span<T>            m_results;  ///<coro i writes its value into m_results[i]
+    };
+
+    template<typename T>
+    struct is_result_span : std::false_type {};
+
+    template<typename T>
+    struct is_result_span<result_span_t<T>> : std::true_type {};
+
+    /**
+    * \brief Await a vector of coros without allocating a vector for the results.
+    *
+    * Each coro writes its value directly into its slot of the buffer, and co_await returns the buffer.
+    *
+    * \param[in] coros The coros to run.
+    * \param[in] results The buffer for the results, must have at least as many elements as there are coros.
+    * \returns the awaitable argument for co_await.
+    */
+    template<typename T>
+    inline result_span_t<T> collect(n_pmr::vector<Coro<T>>& coros, std::span<T> results) noexcept {
+        return { coros, results };
+    }
+
     /**
     * \brief Schedule a Coro into the job system.
     * Basic function for scheduling a coroutine Coro into the job system.
@@ -69,6 +109,7 @@ namespace vgjs {
 
         auto promise = coro.promise();
 
+        JobSystem::inherit_token(promise, parent);
         promise->m_parent = parent;
         if (tg.value < 0 ) {           //schedule now
             if (parent != nullptr) {
@@ -84,6 +125,23 @@ namespace vgjs {
     };
 
 
+    /**
+    * \brief Prepare a Coro for batch scheduling, but do not schedule it.
+    * The children counter of the parent is not changed.
+    * \param[in] coro A ref to coroutine Coro, whose promise is the job.
+    * \param[in] parent The parent of this Job.
+    * \returns a pointer to the promise.
+    */
+    template<typename T>
+    requires CORO<T>
+    Job_base* prepare_job(T&& coro, Job_base* parent) noexcept {
+        auto promise = coro.promise();
+        JobSystem::inherit_token(promise, parent);
+        promise->m_parent = parent;
+        return promise;
+    };
+
+
     template<typename T>
     requires CORO<T>
     void continuation(T&& coro) noexcept {
@@ -95,6 +153,77 @@ namespace vgjs {
     };
 
 
+    /**
+    * \brief Schedule a Coro from a thread that is not a worker thread, and block until it has finished.
+    * \param[in] coro The Coro to schedule.
+    * \returns the value returned by the Coro, if it is not a Coro<void>.
+    */
+    template<typename T>
+    requires CORO<T>
+    decltype(auto) schedule_and_wait(T&& coro) noexcept {
+        schedule_and_wait(Function{ [&]() { schedule(coro); } });   //the coro's parent is a Function, its value is shared
+        if constexpr (requires { coro.get(); }) {
+            return coro.get();
+        }
+    }
+
+    /**
+    * \brief Schedule a Coro and run jobs on the calling thread until it has finished.
+    *
+    * Must not be called from a coroutine, a coroutine should co_await the Coro instead.
+    *
+    * \param[in] coro The Coro to schedule.
+    * \returns the value returned by the Coro, if it is not a Coro<void>.
+    */
+    template<typename T>
+    requires CORO<T>
+    decltype(auto) run_until(T&& coro) noexcept {
+        if (current_job() != nullptr && current_job()->is_coro()) {
+            std::cout << "Error: run_until() must not be called from a coroutine\n";
+            std::terminate();
+        }
+        run_until(Function{ [&]() { schedule(coro); } });     //the coro's parent is a Function, its value is shared
+        if constexpr (requires { coro.get(); }) {
+            return coro.get();
+        }
+    }
+
+
+    /**
+    * \brief Reduce a range in parallel, using lazy binary splitting of parallel_for().
+    *
+    * Each thread keeps its own partial result, starting with identity. The function f is called
+    * for sub ranges as f(range, partial) and returns the new partial result of the thread.
+    * Finally all partial results are combined, so combine must be associative and commutative.
+    * The reduction is a Coro<T>, so it can be awaited or scheduled like any other Coro.
+    *
+    * \param[in] range The range to reduce.
+    * \param[in] identity The identity element of combine.
+    * \param[in] f Function T f(range_t<I>, T) reducing a sub range onto a partial result.
+    * \param[in] combine Function T combine(T, T) combining two partial results.
+    * \param[in] grain Minimum number of elements processed by a job.
+    * \returns the reduced value.
+    */
+    template<typename I, typename T, typename F, typename C>
+    Coro<T> parallel_reduce(range_t<I> range, T identity, F f, C combine, std::type_identity_t<I> grain = 1) {
+        struct alignas(64) partial_t {      //one result per thread, padded against false sharing
+            T m_value;
+        };
+        n_pmr::vector<partial_t> partials(JobSystem().get_thread_count().value, partial_t{ identity });
+
+        co_await parallel_for(range, grain, [&](range_t<I> sub) {
+            auto& partial = partials[JobSystem().get_thread_index().value].m_value;
+            partial = f(sub, partial);
+        });
+
+        T result = identity;
+        for (auto& partial : partials) {
+            result = combine(result, partial.m_value);
+        }
+        co_return result;
+    }
+
+
     //---------------------------------------------------------------------------------------------------
     //Deallocators
 
@@ -211,6 +340,32 @@ namespace vgjs {
     };
 
 
+    /**
+    * \brief Awaitable for testing the cancel token of a coro. Never suspends.
+    */
+    struct awaitable_cancel_check : suspend_always {
+        bool m_cancelled;   ///<true if the token of the coro has been cancelled
+
+        bool await_ready() noexcept { return true; }        ///<never suspend
+        bool await_resume() noexcept { return m_cancelled; } ///<\returns true if the coro should stop
+
+        /**
+        * \brief Awaiter constructor
+        * \parameter[in] cancelled True if the token of the coro has been cancelled
+        */
+        awaitable_cancel_check(bool cancelled) noexcept : m_cancelled(cancelled) {};
+    };
+
+
+    /**
+    * \brief Base class for awaitables that are defined outside of this header, e.g. the I/O awaitables in VGJSIO.h.
+    *
+    * co_await uses such awaitables as they are. Their await_suspend() gets the handle of the coro, and must
+    * eventually reschedule the promise with JobSystem::schedule_job() to resume the coro.
+    */
+    struct awaitable_external {};
+
+
     /**
     * \brief Awaitable for scheduling jobs.
     * All jobs are put into std::tuples.
@@ -232,6 +387,9 @@ namespace vgjs {
             if constexpr (is_pmr_vector< std::decay_t<U> >::value) { //if this is a vector
                 return children.size();
             }
+            if constexpr (is_result_span< std::decay_t<U> >::value) { //if this is a vector with a result buffer
+                return children.m_coros.size();
+            }
             if constexpr (std::is_same_v<std::decay_t<U>, tag_t>) { //if this is a tag
                 m_tag = children;
                 return 0;
@@ -273,6 +431,17 @@ namespace vgjs {
                 if constexpr (std::is_same_v<std::decay_t<T>, tag_t> ) { //never schedule tags here
                     return;
                 }
+                else if constexpr (is_result_span<std::decay_t<T>>::value) {    //coros write into the result buffer
+                    if (children.m_results.size() < children.m_coros.size()) {
+                        std::cout << "Error: result buffer of collect() is too small\n";
+                        std::terminate();
+                    }
+                    for (std::size_t i = 0; i < children.m_coros.size(); ++i) {
+                        children.m_coros[i].set_result(&children.m_results[i]);
+                    }
+                    schedule(children.m_coros, m_tag, &h.promise(), (int)m_number);
+                    m_number = 0;
+                }
                 else {
                     /*if constexpr (std::is_reference_v<T>) {
                         if constexpr (std::is_rvalue_reference_v<T>) {
@@ -342,6 +511,18 @@ namespace vgjs {
             return std::make_tuple(std::move(ret));
         }
 
+        /**
+        * \brief The results have been written into the buffer already.
+        *
+        * \param[in] r The coros and their result buffer.
+        * \returns a tuple holding the result buffer.
+        *
+        */
+        template<typename T>
+        decltype(auto) get_val(result_span_t<T>& r) {
+            return std::make_tuple(r.m_results);
+        }
+
         /**
         * \brief Return the results from the co_await
         * \returns the results from the co_await
@@ -383,21 +564,9 @@ namespace vgjs {
         * \brief After suspension, call parent to run it as continuation
         * \param[in] h Handle of the coro, is used to get the promise (=Job)
         */
-        void await_suspend(n_exp::coroutine_handle<Coro_promise<U>> h) noexcept { //called after suspending
+        n_exp::coroutine_handle<> await_suspend(n_exp::coroutine_handle<Coro_promise<U>> h) noexcept { //called after suspending
             auto& promise = h.promise();
-
-            if (promise.m_parent != nullptr) {          //if there is a parent
-                if (promise.m_is_parent_function) {       //if it is a Job
-                    JobSystem().child_finished((Job*)promise.m_parent); //indicate that this child has finished
-                }
-                else {  //parent is a coro
-                    uint32_t num = promise.m_parent->m_children.fetch_sub(1);   //one less child
-                    if (num == 1) {                                             //was it the last child?
-                        JobSystem().schedule_job(promise.m_parent);      //if last reschedule the parent coro
-                    }
-                }
-            }
-            return;
+            return notify_parent(promise.m_parent, promise.m_is_parent_function);   //maybe resume the parent right away
         }
     };
 
@@ -418,26 +587,223 @@ namespace vgjs {
         * \brief After suspension, call parent to run it as continuation
         * \param[in] h Handle of the coro, is used to get the promise (=Job)
         */
-        bool await_suspend(n_exp::coroutine_handle<Coro_promise<U>> h) noexcept { //called after suspending
+        n_exp::coroutine_handle<> await_suspend(n_exp::coroutine_handle<Coro_promise<U>> h) noexcept { //called after suspending
             auto& promise = h.promise();
+            if (promise.has_deadline()) JobSystem().count_deadline_miss(promise.m_deadline, promise.m_type);  //once, when the coro finishes
             bool is_parent_function = promise.m_is_parent_function;
-            auto parent = promise.m_parent;
+            auto next = notify_parent(promise.m_parent, is_parent_function);
 
-            if (parent != nullptr) {          //if there is a parent
-                if (is_parent_function) {       //if it is a Job
-                    JobSystem().child_finished((Job*)parent);//indicate that this child has finished
-                }
-                else {
-                    uint32_t num = parent->m_children.fetch_sub(1);        //one less child
-                    if (num == 1) {                                             //was it the last child?
-                        JobSystem().schedule_job(parent);      //if last reschedule the parent coro
+            if (is_parent_function && promise.release()) {    //if the future still lives, it will destroy the promise
+                h.destroy();                                    //else destroy it now, do not touch the frame afterwards
+            }
+            return next;    //if parent is coro, then you are in sync -> the future will destroy the promise
+        }
+    };
+
+
+    //---------------------------------------------------------------------------------------------------
+    //Allocating coroutine frames
+
+    /**
+    * \brief Memory resource that caches coroutine frames per thread, bucketed by their size.
+    *
+    * Frames are rounded up to a multiple of c_granularity bytes. Each thread keeps a free list
+    * for each size and resource, so allocating and freeing a frame usually does not need any synchronization.
+    * If a thread caches too many frames of a size (e.g. because it destroys frames that other threads
+    * created), it moves a batch to a central list, from where other threads can take them again.
+    * Frames larger than c_max_size are taken from the upstream resource directly.
+    * The central lists are shared with the thread caches, so they stay valid if the resource is destroyed
+    * before the threads. The upstream resource must live until all threads that used the resource have exited.
+    */
+    class CoroFrameResource : public n_pmr::memory_resource {
+        static inline const std::size_t c_granularity = 64;     ///<frame sizes are multiples of this
+        static inline const std::size_t c_num_buckets = 64;     ///<number of size classes
+        static inline const std::size_t c_max_size = c_granularity * c_num_buckets; ///<larger frames are not cached
+        static inline const uint32_t    c_batch = 32;           ///<number of frames moved to and from the central list
+        static inline const uint32_t    c_max_cached = 4 * c_batch; ///<max number of frames a thread caches per size
+
+        struct block_t {
+            block_t* m_next = nullptr;
+        };
+
+        struct bucket_t {                   ///<thread local free list of one size class
+            block_t*    m_head = nullptr;
+            uint32_t    m_size = 0;
+        };
+
+        struct alignas(64) central_t {      ///<shared free list of one size class
+            std::atomic_flag        m_lock = ATOMIC_FLAG_INIT;
+            std::atomic<block_t*>   m_head = nullptr;   ///<written only with m_lock held, read without it to skip empty lists
+        };
+
+        struct shared_t {                   ///<central lists of one resource, shared with the thread caches
+            n_pmr::memory_resource* m_upstream;         ///<allocate frames from here
+            central_t               m_central[c_num_buckets];
+
+            explicit shared_t(n_pmr::memory_resource* upstream) noexcept : m_upstream{ upstream } {}
+
+            ~shared_t() {                   //the resource and all thread caches are gone, give all frames back to upstream
+                for (std::size_t i = 0; i < c_num_buckets; ++i) {
+                    block_t* block = m_central[i].m_head.load(std::memory_order::relaxed);
+                    while (block != nullptr) {
+                        block_t* next = block->m_next;
+                        m_upstream->deallocate(block, (i + 1) * c_granularity, alignof(std::max_align_t));
+                        block = next;
                     }
                 }
             }
-            return !is_parent_function; //if parent is coro, then you are in sync -> the future will destroy the promise
+
+            /**
+            * \brief Move frames from a thread local list to the central list.
+            * \param[in] bucket The thread local list.
+            * \param[in] idx The size class.
+            * \param[in] num Number of frames to move.
+            */
+            void flush(bucket_t& bucket, std::size_t idx, uint32_t num) noexcept {
+                block_t* head = bucket.m_head;
+                block_t* tail = head;
+                for (uint32_t i = 1; i < num; ++i) tail = tail->m_next;
+                bucket.m_head = tail->m_next;
+                bucket.m_size -= num;
+
+                central_t& central = m_central[idx];
+                while (central.m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+                tail->m_next = central.m_head.load(std::memory_order::relaxed);
+                central.m_head.store(head, std::memory_order::relaxed);
+                central.m_lock.clear(std::memory_order::release);                 //release lock
+            }
+
+            /**
+            * \brief Move a batch of frames from the central list to a thread local list.
+            * \param[in] bucket The thread local list.
+            * \param[in] idx The size class.
+            */
+            void refill(bucket_t& bucket, std::size_t idx) noexcept {
+                central_t& central = m_central[idx];
+                if (central.m_head.load(std::memory_order::relaxed) == nullptr) return;  //nothing there, do not lock
+                while (central.m_lock.test_and_set(std::memory_order::acquire));  // acquire lock
+                block_t* block = central.m_head.load(std::memory_order::relaxed);
+                for (uint32_t i = 0; i < c_batch && block != nullptr; ++i) {
+                    block_t* next = block->m_next;
+                    block->m_next = bucket.m_head;
+                    bucket.m_head = block;
+                    ++bucket.m_size;
+                    block = next;
+                }
+                central.m_head.store(block, std::memory_order::relaxed);
+                central.m_lock.clear(std::memory_order::release);                 //release lock
+            }
+        };
+
+        struct cache_t {                    ///<free lists of one thread for one resource
+            std::shared_ptr<shared_t> m_shared;
+            bucket_t m_buckets[c_num_buckets];
+
+            explicit cache_t(std::shared_ptr<shared_t> shared) noexcept : m_shared{ std::move(shared) } {}
+
+            ~cache_t() {                    //thread exits, give the frames to the central lists
+                for (std::size_t i = 0; i < c_num_buckets; ++i) {
+                    if (m_buckets[i].m_size > 0) m_shared->flush(m_buckets[i], i, m_buckets[i].m_size);
+                }
+            }
+        };
+
+        std::shared_ptr<shared_t> m_shared;     ///<central lists and upstream
+
+        /**
+        * \brief Get the free lists of this thread for this resource.
+        * \returns the cache of this thread.
+        */
+        cache_t& cache() noexcept {
+            thread_local std::vector<std::unique_ptr<cache_t>> caches;     //one for each resource this thread has used
+            thread_local cache_t* last = nullptr;                           //the one used last
+            if (last != nullptr && last->m_shared == m_shared) return *last;
+            for (auto& c : caches) {
+                if (c->m_shared == m_shared) return *(last = c.get());
+            }
+            caches.emplace_back(std::make_unique<cache_t>(m_shared));      //keeps the central lists alive
+            return *(last = caches.back().get());
+        }
+
+    protected:
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+            if (bytes > c_max_size || alignment > alignof(std::max_align_t)) {
+                return m_shared->m_upstream->allocate(bytes, alignment);
+            }
+            std::size_t idx = (bytes + c_granularity - 1) / c_granularity - 1;
+            bucket_t& bucket = cache().m_buckets[idx];
+            if (bucket.m_head == nullptr) {
+                m_shared->refill(bucket, idx);
+                if (bucket.m_head == nullptr) {
+                    return m_shared->m_upstream->allocate((idx + 1) * c_granularity, alignof(std::max_align_t));
+                }
+            }
+            block_t* block = bucket.m_head;
+            bucket.m_head = block->m_next;
+            --bucket.m_size;
+            return block;
         }
+
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+            if (bytes > c_max_size || alignment > alignof(std::max_align_t)) {
+                return m_shared->m_upstream->deallocate(p, bytes, alignment);
+            }
+            std::size_t idx = (bytes + c_granularity - 1) / c_granularity - 1;
+            bucket_t& bucket = cache().m_buckets[idx];
+            block_t* block = new (p) block_t{ bucket.m_head };
+            bucket.m_head = block;
+            if (++bucket.m_size > c_max_cached) {
+                m_shared->flush(bucket, idx, c_batch);  //too many frames of this size
+            }
+        }
+
+        bool do_is_equal(const n_pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+    public:
+
+        /**
+        * \brief Constructor.
+        * \param[in] upstream Memory resource for allocating the frames.
+        */
+        explicit CoroFrameResource(n_pmr::memory_resource* upstream = n_pmr::new_delete_resource()) noexcept
+            : m_shared(std::make_shared<shared_t>(upstream)) {};
+
+        CoroFrameResource(const CoroFrameResource&) = delete;
+
+        /**
+        * \brief Get the upstream resource.
+        * \returns the resource frames are allocated from.
+        */
+        n_pmr::memory_resource* upstream() const noexcept { return m_shared->m_upstream; }
     };
 
+    /**
+    * \brief Get the memory resource that is used for coroutine frames if no other resource is given.
+    *
+    * Frames are taken from the memory resource of the job system, through a CoroFrameResource for this
+    * resource. There is one CoroFrameResource for each resource the job system was started with.
+    * Coros created before the job system has been started use the new/delete resource.
+    *
+    * \returns a pointer to the frame resource.
+    */
+    inline n_pmr::memory_resource* coro_frame_resource() noexcept {
+        n_pmr::memory_resource* upstream = JobSystem::is_instance_created() ? JobSystem().memory_resource() : n_pmr::new_delete_resource();  //do not start the system here
+        thread_local CoroFrameResource* last = nullptr;                 //the one used last by this thread
+        if (last != nullptr && last->upstream() == upstream) return last;
+
+        static std::mutex mutex;
+        static std::vector<std::unique_ptr<CoroFrameResource>> resources;  //one per upstream, live until the program ends
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& r : resources) {
+            if (r->upstream() == upstream) return last = r.get();
+        }
+        resources.emplace_back(std::make_unique<CoroFrameResource>(upstream));
+        return last = resources.back().get();
+    }
+
 
     //---------------------------------------------------------------------------------------------------
     //The coro promise classes
@@ -455,7 +821,7 @@ namespace vgjs {
 
     protected:
         n_exp::coroutine_handle<> m_coro;   ///<handle of the coroutine
-        bool m_is_parent_function = current_job() == nullptr ? true : current_job()->is_function(); ///<is the parent a Function or nullptr?
+        bool m_is_parent_function = current_job() == nullptr ? true : !current_job()->is_coro(); ///<is the parent a Function, a graph node or nullptr?
         bool* m_ready_ptr = nullptr;        ///<points to flag which is true if value is ready, else false
         bool m_self_destruct = false;
 
@@ -464,7 +830,7 @@ namespace vgjs {
         * \brief Constructor
         * \param[in] coro The handle of the coroutine (typeless because the base class does not depend on types)
         */
-        explicit Coro_promise_base(n_exp::coroutine_handle<> coro) noexcept : Job_base(), m_coro(coro) {};
+        explicit Coro_promise_base(n_exp::coroutine_handle<> coro) noexcept : Job_base(), m_coro(coro) { m_is_coro = true; };
 
         /**
         * \brief React to unhandled exceptions
@@ -490,9 +856,45 @@ namespace vgjs {
             return true;
         };
 
+        /**
+        * \brief Prepare resuming the Coro directly through symmetric transfer, as resume() would do.
+        * \returns the handle of the coroutine.
+        */
+        n_exp::coroutine_handle<> resume_handle() noexcept {
+            if (m_is_parent_function && m_ready_ptr != nullptr) {
+                *m_ready_ptr = false;   //invalidate return value
+            }
+            return m_coro;
+        }
+
         void set_self_destruct(bool b = true) { m_self_destruct = b; }
         bool get_self_destruct() { return m_self_destruct; }
 
+        /**
+        * \brief Set the options of the coro before it is scheduled, options that are not given get their defaults.
+        * \param[in] options Thread index, type, id, priority, cancel token, placement or budget, in any order.
+        */
+        template<typename... Ts>
+        requires (JOB_OPTION<Ts> && ...)
+        void set_options(Ts&&... options) noexcept {
+            m_thread_index = thread_index_t{};
+            m_type = thread_type_t{};
+            m_id = thread_id_t{};
+            m_priority = priority_t{};
+            m_token = nullptr;
+            m_placement = placement_t{};
+            m_deadline = c_no_deadline;
+            (set_option(std::forward<Ts>(options)), ...);
+        }
+
+        void set_option(thread_index_t index) noexcept { m_thread_index = index; }
+        void set_option(thread_type_t type) noexcept { m_type = type; }
+        void set_option(thread_id_t id) noexcept { m_id = id; }
+        void set_option(priority_t priority) noexcept { m_priority = priority; }
+        void set_option(cancel_token_t* token) noexcept { m_token = token; }
+        void set_option(placement_t placement) noexcept { m_placement = placement; }
+        void set_option(budget_t budget) noexcept { m_deadline = JobSystem().deadline(budget); }  //coros cannot be optional
+
         //operators for allocating and deallocating memory, implementations follow later in this file
         template<typename... Args>
         void* operator new(std::size_t sz, std::allocator_arg_t, n_pmr::memory_resource* mr, Args&&... args) noexcept;
@@ -523,8 +925,9 @@ namespace vgjs {
         template<typename F> friend class Coro;
 
     protected:
-        std::shared_ptr<std::pair<bool, T>> m_value_ptr;    ///<a shared view of the return value, use if parent is a function
-        std::pair<bool, T>                  m_value;        ///<a local storage of the value, use if parent is a coroutine
+        std::pair<bool, T>                  m_value;        ///<storage of the value
+        T*                                  m_result = nullptr; ///<if not nullptr then the value is written here instead, see collect()
+        std::atomic<int>                    m_refs = 1;     ///<if the parent is a function, the future and the running coro share the promise
 
     public:
 
@@ -541,18 +944,35 @@ namespace vgjs {
         /**
         * \returns a deallocator, used only if program ends.
         */
-        job_deallocator get_deallocator() noexcept { return coro_deallocator<T>{}; };    //called for deallocation
+        job_deallocator& get_deallocator() noexcept { static coro_deallocator<T> deallocator; return deallocator; };    //called for deallocation
 
         /**
         * \brief Store the value returned by co_return.
         * \param[in] t The value that was returned.
         */
         void return_value(T t) noexcept {   //is called by co_return <VAL>, saves <VAL> in m_value
-            if (m_is_parent_function) {
-                *m_value_ptr = std::make_pair(true, t);
+            store(std::move(t));
+        }
+
+        /**
+        * \brief Store a value, either in the promise or in the result slot given by the parent.
+        * \param[in] t The value.
+        */
+        void store(T&& t) noexcept {
+            if (m_result != nullptr) {
+                *m_result = std::move(t);
+                m_value.first = true;
                 return;
             }
-            m_value = std::make_pair(true, t);
+            m_value = std::make_pair(true, std::move(t));
+        }
+
+        /**
+        * \brief The future or the finished coro let go of a shared promise.
+        * \returns true if this was the last reference, then the promise must be destroyed.
+        */
+        bool release() noexcept {
+            return m_refs.fetch_sub(1) == 1;
         }
 
         /**
@@ -561,12 +981,7 @@ namespace vgjs {
         * \returns a yield_awaiter
         */
         yield_awaiter<T> yield_value(T t) noexcept {
-            if (m_is_parent_function) {
-                *m_value_ptr = std::make_pair(true, t);
-            }
-            else {
-                m_value = std::make_pair(true, t);
-            }
+            store(std::move(t));
             return {};  //return a yield_awaiter
         }
 
@@ -598,6 +1013,28 @@ namespace vgjs {
         */
         awaitable_tag<T> await_transform(tag_t tg) noexcept { return { tg }; };
 
+        /**.
+        * \brief Called by co_await to set where this coro resumes after its children have finished.
+        * \param[in] placement placement_last_child, placement_any, or the index of a preferred thread.
+        * \returns an awaitable that does not suspend.
+        */
+        n_exp::suspend_never await_transform(placement_t placement) noexcept { this->m_placement = placement; return {}; };
+
+        /**.
+        * \brief Called by co_await to test the cancel token of this coro.
+        * \returns the awaitable for this parameter type of the co_await operator.
+        */
+        awaitable_cancel_check await_transform(cancel_check_t) noexcept;
+
+        /**.
+        * \brief Called by co_await for awaitables that are defined outside of this header.
+        * \param[in] awaitable The awaitable, e.g. an I/O operation.
+        * \returns the awaitable itself.
+        */
+        template<typename U>
+        requires EXTERNAL_AWAITABLE<U>
+        std::decay_t<U> await_transform(U&& awaitable) noexcept { return std::forward<U>(awaitable); };
+
         /**
         * \brief Create the final awaiter. This awaiter makes sure that the parent is scheduled if there are no more children.
         * \returns the final awaiter.
@@ -653,11 +1090,25 @@ namespace vgjs {
     public:
         using promise_type = Coro_promise<T>;
         bool m_is_parent_function;                          ///<if true then the parent is a function or nullptr
-        std::shared_ptr<std::pair<bool, T>> m_value_ptr;    ///<pointer to the value, use only if parent is a function or nullptr
 
     private:
         n_exp::coroutine_handle<promise_type> m_coro;       ///<handle to Coro promise
 
+        /**
+        * \brief Let go of the promise. If the parent is a coroutine the promise is destroyed, else
+        * the promise is destroyed by whoever of the future and the finished coro comes last.
+        */
+        void release() noexcept {
+            if (!m_coro) return;
+            if (m_is_parent_function) {
+                if (m_coro.promise().release()) m_coro.destroy();
+            }
+            else if (!m_coro.promise().get_self_destruct()) {
+                m_coro.destroy();
+            }
+            m_coro = {};
+        }
+
     public:
         /**
         * \brief Coro future constructor
@@ -667,17 +1118,10 @@ namespace vgjs {
         /**
         * \brief Coro future constructor
         * \param[in] h Coroutine handle
-        * \param[in] value_ptr Shared pointer to the value to return, used only if parent is a function or nullptr
-        * \param[in] is_parent_function Flag for using shared value pointer
+        * \param[in] is_parent_function If true then the future and the coro share the promise
         */
-        Coro(   n_exp::coroutine_handle<promise_type> h
-                , std::shared_ptr<std::pair<bool, T>>& value_ptr
-                , bool is_parent_function) noexcept
-            : Coro_base(&h.promise()), m_coro(h), m_is_parent_function(is_parent_function) {
-            if (m_is_parent_function) {
-                m_value_ptr = value_ptr;
-            }
-        };
+        Coro(n_exp::coroutine_handle<promise_type> h, bool is_parent_function) noexcept
+            : Coro_base(&h.promise()), m_coro(h), m_is_parent_function(is_parent_function) {};
 
         /**
         * \brief Coro future constructor
@@ -685,7 +1129,6 @@ namespace vgjs {
         */
         Coro(Coro<T>&& t)  noexcept : Coro_base(t.m_promise)
                                         , m_coro(std::exchange(t.m_coro, {}))
-                                        , m_value_ptr(std::exchange(t.m_value_ptr, {}))
                                         , m_is_parent_function(std::exchange(t.m_is_parent_function, {})) {};
 
         /**
@@ -693,9 +1136,9 @@ namespace vgjs {
         * \param[in] t Source coroutine that is moved into this coroutine
         */
         void operator= (Coro<T>&& t) noexcept {
+            release();
             m_is_parent_function    = t.m_is_parent_function;
             m_coro                  = std::exchange(t.m_coro, {});
-            m_value_ptr             = std::exchange( t.m_value_ptr, nullptr );
             m_promise               = std::exchange( t.m_promise, {});
         }
 
@@ -703,10 +1146,7 @@ namespace vgjs {
         * \brief Destructor of the Coro promise.
         */
         ~Coro() noexcept {
-            if (!m_is_parent_function && m_coro) { //destroy the promise only if the parent is a coroutine (else it would destroy itself)
-                if (m_coro.promise().get_self_destruct()) return;
-                m_coro.destroy();
-            }
+            release();
         }
 
         /**
@@ -714,9 +1154,6 @@ namespace vgjs {
         * \returns true if promised value is available, else false
         */
         bool ready() noexcept {
-            if (m_is_parent_function) {
-                return m_value_ptr->first;
-            }
             return m_coro.promise().m_value.first;
         }
 
@@ -725,24 +1162,32 @@ namespace vgjs {
         * \returns the promised value
         */
         T get() noexcept {
-            if (m_is_parent_function) {
-                return m_value_ptr->second;
-            }
             return m_coro.promise().m_value.second;
         }
 
+        /**
+        * \brief Let the coro write its value into the given slot instead of the promise.
+        * \param[in] result Pointer to the slot, must live until the coro has finished.
+        */
+        void set_result(T* result) noexcept {
+            m_coro.promise().m_result = result;
+        }
+
         /**
         * \brief Function operator so you can pass on parameters to the Coro.
         *
-        * \param[in] thread_index The thread that should execute this coro
-        * \param[in] type The type of the coro.
-        * \param[in] id A unique ID of the call.
+        * The parameters can be given in any order, parameters that are not given get their defaults:
+        * the thread that should execute this coro (thread_index_t), its type (thread_type_t), a unique ID
+        * of the call (thread_id_t), its priority (priority_t), the cancel token of the coro and its children,
+        * its placement (placement_t), and its deadline (budget_t, coros cannot be optional).
+        *
+        * \param[in] options The parameters.
         * \returns a reference to this Coro so that it can be used with co_await.
         */
-        decltype(auto) operator() (thread_index_t index = thread_index_t{}, thread_type_t type = thread_type_t{}, thread_id_t id = thread_id_t{}) {
-            m_promise->m_thread_index = index;
-            m_promise->m_type = type;
-            m_promise->m_id = id;
+        template<typename... Ts>
+        requires (JOB_OPTION<Ts> && ...)
+        decltype(auto) operator() (Ts&&... options) {
+            m_promise->set_options(std::forward<Ts>(options)...);
             return std::move(*this);
         }
     };
@@ -755,7 +1200,7 @@ namespace vgjs {
     */
     template<>
     struct yield_awaiter<void> : public suspend_always {
-        void await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept;
+        n_exp::coroutine_handle<> await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept;
     };
 
     /**
@@ -763,7 +1208,7 @@ namespace vgjs {
     */
     template<>
     struct final_awaiter<void> : public n_exp::suspend_always {
-        bool await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept;
+        n_exp::coroutine_handle<> await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept;
     };
 
     /**
@@ -789,7 +1234,7 @@ namespace vgjs {
         /**
         * \returns a deallocator, used only if program ends.
         */
-        job_deallocator get_deallocator() noexcept { return coro_deallocator<void>{}; };    //called for deallocation
+        job_deallocator& get_deallocator() noexcept { static coro_deallocator<void> deallocator; return deallocator; };    //called for deallocation
 
         /**
         * \brief Return from aco_return.
@@ -830,6 +1275,28 @@ namespace vgjs {
         */
         awaitable_tag<void> await_transform(tag_t tg) noexcept { return { tg }; };
 
+        /**.
+        * \brief Called by co_await to set where this coro resumes after its children have finished.
+        * \param[in] placement placement_last_child, placement_any, or the index of a preferred thread.
+        * \returns an awaitable that does not suspend.
+        */
+        n_exp::suspend_never await_transform(placement_t placement) noexcept { this->m_placement = placement; return {}; };
+
+        /**.
+        * \brief Called by co_await to test the cancel token of this coro.
+        * \returns the awaitable for this parameter type of the co_await operator.
+        */
+        awaitable_cancel_check await_transform(cancel_check_t) noexcept;
+
+        /**.
+        * \brief Called by co_await for awaitables that are defined outside of this header.
+        * \param[in] awaitable The awaitable, e.g. an I/O operation.
+        * \returns the awaitable itself.
+        */
+        template<typename U>
+        requires EXTERNAL_AWAITABLE<U>
+        std::decay_t<U> await_transform(U&& awaitable) noexcept { return std::forward<U>(awaitable); };
+
         /**
         * \brief Create the final awaiter. This awaiter makes sure that the parent is scheduled if there are no more children.
         * \returns the final awaiter.
@@ -897,15 +1364,18 @@ namespace vgjs {
         /**
         * \brief Function operator so you can pass on parameters to the Coro.
         *
-        * \param[in] thread_index The thread that should execute this coro
-        * \param[in] type The type of the coro.
-        * \param[in] id A unique ID of the call.
+        * The parameters can be given in any order, parameters that are not given get their defaults:
+        * the thread that should execute this coro (thread_index_t), its type (thread_type_t), a unique ID
+        * of the call (thread_id_t), its priority (priority_t), the cancel token of the coro and its children,
+        * its placement (placement_t), and its deadline (budget_t, coros cannot be optional).
+        *
+        * \param[in] options The parameters.
         * \returns a reference to this Coro so that it can be used with co_await.
         */
-        decltype(auto) operator() (thread_index_t index = thread_index_t{}, thread_type_t type = thread_type_t{}, thread_id_t id = thread_id_t{}) {
-            m_promise->m_thread_index = index;
-            m_promise->m_type = type;
-            m_promise->m_id = id;
+        template<typename... Ts>
+        requires (JOB_OPTION<Ts> && ...)
+        decltype(auto) operator() (Ts&&... options) {
+            m_promise->set_options(std::forward<Ts>(options)...);
             return std::move(*this);
         }
     };
@@ -928,8 +1398,8 @@ namespace vgjs {
     inline void coro_deallocator<T>::deallocate(Job_base* job) noexcept {    //called when the job system is destroyed
         auto coro_promise = (Coro_promise<T>*)job;
         auto coro = n_exp::coroutine_handle<Coro_promise<T>>::from_promise(*coro_promise);
-        if (coro) {
-            coro.destroy();
+        if (coro && (!coro_promise->m_is_parent_function || coro_promise->release())) {
+            coro.destroy();     //if the future still lives, it destroys the promise
         }
     };
 
@@ -950,50 +1420,63 @@ namespace vgjs {
 
 
     /**
-    * \brief After suspension, call parent to run it as continuation
-    * \param[in] h Handle of the coro, is used to get the promise (=Job)
+    * \brief A child coro has finished or yielded, so notify its parent.
+    *
+    * If the parent is not a coro, e.g. a Function or a graph node, the child is finished for it. If the parent is a coro and this was
+    * its last child, the parent is resumed right away on this thread through symmetric transfer,
+    * instead of going through a queue. This is only done if the parent may run on this thread,
+    * else it is scheduled as usual.
+    *
+    * \param[in] parent The parent of the child, or nullptr.
+    * \param[in] is_parent_function True if the parent is not a coro.
+    * \returns the handle of the coro to resume next, or a noop handle.
     */
-    inline void yield_awaiter<void>::await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept { //called after suspending
-        Coro_promise<void>& promise = h.promise();                 ///<tmp pointer to promise
-        bool is_parent_function = promise.m_is_parent_function;    ///<tmp copy of flag
-        auto parent = promise.m_parent;                            ///<tmp pointer to parent
-
-        if (parent != nullptr) {          //if there is a parent
-            if (is_parent_function) {       //if it is a Job
-                JobSystem().child_finished((Job*)parent); //indicate that this child has suspended
+    inline n_exp::coroutine_handle<> notify_parent(Job_base* parent, bool is_parent_function) noexcept {
+        if (parent != nullptr) {            //if there is a parent
+            JobSystem js;
+            if (is_parent_function || !parent->is_coro()) {  //a Job, the group of a large batch, or a graph node
+                js.child_finished(parent);          //indicate that this child has finished
             }
-            else {  //parent is a coro
+            else {
                 uint32_t num = parent->m_children.fetch_sub(1);   //one less child
                 if (num == 1) {                                   //was it the last child?
-                    JobSystem().schedule_job(parent);       //if last reschedule the parent coro
+                    if (js.can_run_here(parent)) {
+                        JobSystem::set_current_job(parent);       //resume the parent coro right here
+                        return static_cast<Coro_promise_base*>(parent)->resume_handle();
+                    }
+                    js.schedule_placed(parent);    //else reschedule the parent coro
                 }
             }
         }
-        return;
+        return n_exp::noop_coroutine();
+    }
+
+    /**
+    * \brief After suspension, call parent to run it as continuation
+    * \param[in] h Handle of the coro, is used to get the promise (=Job)
+    * \returns the handle of the coro to resume next.
+    */
+    inline n_exp::coroutine_handle<> yield_awaiter<void>::await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept { //called after suspending
+        Coro_promise<void>& promise = h.promise();                 ///<tmp pointer to promise
+        return notify_parent(promise.m_parent, promise.m_is_parent_function);
     }
 
 
     /**
     * \brief After suspension, call parent to run it as continuation
     * \param[in] h Handle of the coro, is used to get the promise (=Job)
+    * \returns the handle of the coro to resume next.
     */
-    inline bool final_awaiter<void>::await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept { //called after suspending
+    inline n_exp::coroutine_handle<> final_awaiter<void>::await_suspend(n_exp::coroutine_handle<Coro_promise<void>> h) noexcept { //called after suspending
         Coro_promise<void>& promise = h.promise();                 ///<tmp pointer to promise
+        if (promise.has_deadline()) JobSystem().count_deadline_miss(promise.m_deadline, promise.m_type);  //once, when the coro finishes
         bool is_parent_function = promise.m_is_parent_function;    ///<tmp copy of flag
-        auto parent = promise.m_parent;                            ///<tmp pointer to parent
+        auto next = notify_parent(promise.m_parent, is_parent_function);
 
-        if (parent != nullptr) {            //if there is a parent
-            if (is_parent_function) {       //if it is a Job
-                JobSystem().child_finished((Job*)promise.m_parent);//indicate that this child has finished
-            }
-            else {
-                uint32_t num = parent->m_children.fetch_sub(1);   //one less child
-                if (num == 1) {                                   //was it the last child?
-                    JobSystem().schedule_job(parent);       //if last reschedule the parent coro
-                }
-            }
+        if (is_parent_function) {   //if parent is coro, then you are in sync -> the future will destroy the promise
+            h.destroy();            //else nobody needs the promise anymore, do not touch the frame afterwards
         }
-        return !is_parent_function; //if parent is coro, then you are in sync -> the future will destroy the promise
+        return next;
     }
 
 
@@ -1044,7 +1527,7 @@ namespace vgjs {
     }
 
     /**
-    * \brief Create a promise object for a class member function using the system standard allocator.
+    * \brief Create a promise object for a class member function using the coro frame resource.
     * \param[in] sz Number of bytes to allocate.
     * \param[in] Class The class that defines this member function.
     * \param[in] args the rest of the coro args.
@@ -1052,22 +1535,18 @@ namespace vgjs {
     */
     template<typename Class, typename... Args>
     inline void* Coro_promise_base::operator new(std::size_t sz, Class, Args&&... args) noexcept {
-        return operator new(sz, std::allocator_arg, 
-            JobSystem::is_instance_created() ? JobSystem().memory_resource() : n_pmr::new_delete_resource(), 
-            args...);
+        return operator new(sz, std::allocator_arg, coro_frame_resource(), args...);
     }
 
     /**
-    * \brief Create a promise object using the system standard allocator.
+    * \brief Create a promise object using the coro frame resource.
     * \param[in] sz Number of bytes to allocate.
     * \param[in] args the rest of the coro args.
     * \returns a pointer to the newly allocated promise.
     */
     template<typename... Args>
     inline void* Coro_promise_base::operator new(std::size_t sz, Args&&... args) noexcept {
-        return operator new(sz, std::allocator_arg, 
-            JobSystem::is_instance_created() ? JobSystem().memory_resource() : n_pmr::new_delete_resource(),
-            args...);
+        return operator new(sz, std::allocator_arg, coro_frame_resource(), args...);
     }
 
     /**
@@ -1095,19 +1574,28 @@ namespace vgjs {
     }
 
     /**
-    * \brief Get Coro<T> from the Coro_promise<T>. Creates a shared value to trade the result.
+    * \brief Get Coro<T> from the Coro_promise<T>. If the parent is a function, the future
+    * and the coro share the promise, which then holds the value until both have let go.
     * \returns the Coro<T> from the promise.
     */
     template<typename T>
     inline Coro<T> Coro_promise<T>::get_return_object() noexcept {
         m_ready_ptr = &m_value.first;
         if (m_is_parent_function) {
-            m_value_ptr = std::make_shared<std::pair<bool, T>>(std::make_pair(false, T{}));
-            m_ready_ptr = &(m_value_ptr->first);
+            m_refs = 2;     //one for the future, one for the running coro
         }
 
         return Coro<T>{
-            n_exp::coroutine_handle<Coro_promise<T>>::from_promise(*this), m_value_ptr, m_is_parent_function };
+            n_exp::coroutine_handle<Coro_promise<T>>::from_promise(*this), m_is_parent_function };
+    }
+
+    /**
+    * \brief Test the cancel token of the coro.
+    * \returns the awaitable that returns true if the coro has been cancelled.
+    */
+    template<typename T>
+    inline awaitable_cancel_check Coro_promise<T>::await_transform(cancel_check_t) noexcept {
+        return { m_token != nullptr && m_token->cancelled() };
     }
 
     //---------------------------------------------------------------------------------------------------
@@ -1129,6 +1617,387 @@ namespace vgjs {
         return Coro<void>{n_exp::coroutine_handle<Coro_promise<void>>::from_promise(*this), m_is_parent_function };
     }
 
+    /**
+    * \brief Test the cancel token of the coro.
+    * \returns the awaitable that returns true if the coro has been cancelled.
+    */
+    inline awaitable_cancel_check Coro_promise<void>::await_transform(cancel_check_t) noexcept {
+        return { m_token != nullptr && m_token->cancelled() };
+    }
+
+
+    //---------------------------------------------------------------------------------------------------
+    //Channels and pipelines
+
+    /**
+    * \brief Bounded multi-producer multi-consumer channel for passing items between coros.
+    *
+    * co_await push() suspends the coro while the channel is full, and co_await pop() suspends it while the
+    * channel is empty. Suspended coros are not blocking their threads, they are rescheduled into the job
+    * system when another coro makes room or brings an item. Items are handed over directly to a waiting
+    * consumer. A closed channel does not take new items, but its remaining items can still be popped.
+    * The channel is guarded by a spin lock that is held only for a few instructions.
+    */
+    template<typename T>
+    class Channel {
+        struct waiter_t {                       ///<a suspended coro, lives in its awaitable
+            Job_base*           m_job = nullptr;    ///<the coro to reschedule
+            std::optional<T>    m_value;            ///<item handed over to or from the coro
+            bool                m_ok = false;       ///<push: the item has been taken
+            waiter_t*           m_next = nullptr;
+        };
+
+        struct waiter_list_t {                  ///<FIFO of waiting coros
+            waiter_t* m_head = nullptr;
+            waiter_t* m_tail = nullptr;
+
+            void push(waiter_t* waiter) noexcept {
+                waiter->m_next = nullptr;
+                if (m_tail == nullptr) m_head = waiter; else m_tail->m_next = waiter;
+                m_tail = waiter;
+            }
+
+            waiter_t* pop() noexcept {
+                waiter_t* waiter = m_head;
+                if (waiter != nullptr) {
+                    m_head = waiter->m_next;
+                    if (m_head == nullptr) m_tail = nullptr;
+                }
+                return waiter;
+            }
+        };
+
+        std::atomic_flag                m_lock = ATOMIC_FLAG_INIT;
+        std::vector<std::optional<T>>   m_ring;                 ///<ring buffer of items
+        std::size_t                     m_head = 0;             ///<index of the oldest item
+        std::size_t                     m_size = 0;             ///<number of items in the ring
+        bool                            m_closed = false;
+        waiter_list_t                   m_pushers;              ///<coros waiting because the channel is full
+        waiter_list_t                   m_poppers;              ///<coros waiting because the channel is empty
+
+        void lock() noexcept { while (m_lock.test_and_set(std::memory_order::acquire)); }
+        void unlock() noexcept { m_lock.clear(std::memory_order::release); }
+
+        static void wake(waiter_t* waiter) noexcept {
+            if (waiter != nullptr) JobSystem().schedule_job(waiter->m_job);
+        }
+
+        /**
+        * \brief Give an item to a waiting consumer, or put it into the ring. Call only with the lock held.
+        * \param[in] value The item.
+        * \param[out] woken A consumer that got the item and must be rescheduled.
+        * \returns true if the item was taken, false if the channel is full.
+        */
+        bool push_locked(T& value, waiter_t*& woken) noexcept {
+            if (waiter_t* popper = m_poppers.pop(); popper != nullptr) {
+                popper->m_value.emplace(std::move(value));
+                woken = popper;
+                return true;
+            }
+            if (m_size == m_ring.size()) return false;
+            m_ring[(m_head + m_size) % m_ring.size()].emplace(std::move(value));
+            ++m_size;
+            return true;
+        }
+
+        /**
+        * \brief Take the oldest item, and let a waiting producer put its item into the ring. Call only with the lock held.
+        * \param[out] value Receives the item.
+        * \param[out] woken A producer whose item was taken and that must be rescheduled.
+        * \returns true if there was an item.
+        */
+        bool pop_locked(std::optional<T>& value, waiter_t*& woken) noexcept {
+            if (m_size == 0) return false;
+            value.emplace(std::move(*m_ring[m_head]));
+            m_ring[m_head].reset();
+            m_head = (m_head + 1) % m_ring.size();
+            --m_size;
+            if (waiter_t* pusher = m_pushers.pop(); pusher != nullptr) {
+                m_ring[(m_head + m_size) % m_ring.size()].emplace(std::move(*pusher->m_value));
+                ++m_size;
+                pusher->m_ok = true;
+                woken = pusher;
+            }
+            return true;
+        }
+
+        /**
+        * \brief Push the item of a coro, or queue the coro if the channel is full.
+        * \param[in] waiter The waiter holding the item.
+        * \param[in] job The coro.
+        * \returns true if the coro must suspend.
+        */
+        bool suspend_push(waiter_t& waiter, Job_base* job) noexcept {
+            waiter_t* woken = nullptr;
+            lock();
+            if (!m_closed) {
+                if (push_locked(*waiter.m_value, woken)) {
+                    waiter.m_ok = true;
+                }
+                else {
+                    waiter.m_job = job;
+                    m_pushers.push(&waiter);
+                    unlock();
+                    return true;            //a consumer reschedules the coro
+                }
+            }
+            unlock();
+            wake(woken);
+            return false;
+        }
+
+        /**
+        * \brief Pop an item for a coro, or queue the coro if the channel is empty.
+        * \param[in] waiter The waiter receiving the item.
+        * \param[in] job The coro.
+        * \returns true if the coro must suspend.
+        */
+        bool suspend_pop(waiter_t& waiter, Job_base* job) noexcept {
+            waiter_t* woken = nullptr;
+            lock();
+            if (!pop_locked(waiter.m_value, woken) && !m_closed) {
+                waiter.m_job = job;
+                m_poppers.push(&waiter);
+                unlock();
+                return true;                //a producer reschedules the coro
+            }
+            unlock();
+            wake(woken);
+            return false;
+        }
+
+    public:
+
+        /**
+        * \brief Awaitable returned by push(), co_await returns true if the item was taken, false if the channel was closed.
+        */
+        struct awaitable_push : awaitable_external {
+            Channel*    m_channel;
+            waiter_t    m_waiter;
+
+            bool await_ready() noexcept { return false; }
+            template<typename P>
+            bool await_suspend(n_exp::coroutine_handle<P> h) noexcept { return m_channel->suspend_push(m_waiter, &h.promise()); }
+            bool await_resume() noexcept { return m_waiter.m_ok; }
+        };
+
+        /**
+        * \brief Awaitable returned by pop(), co_await returns the item, or nothing if the channel is closed and empty.
+        */
+        struct awaitable_pop : awaitable_external {
+            Channel*    m_channel;
+            waiter_t    m_waiter;
+
+            bool await_ready() noexcept { return false; }
+            template<typename P>
+            bool await_suspend(n_exp::coroutine_handle<P> h) noexcept { return m_channel->suspend_pop(m_waiter, &h.promise()); }
+            std::optional<T> await_resume() noexcept { return std::move(m_waiter.m_value); }
+        };
+
+        /**
+        * \brief Constructor.
+        * \param[in] capacity Max number of items in the channel, at least 1.
+        */
+        Channel(std::size_t capacity = 64) noexcept : m_ring(std::max<std::size_t>(capacity, 1)) {};
+        Channel(const Channel&) = delete;
+
+        /**
+        * \brief Put an item into the channel, use as co_await push(item).
+        * \param[in] value The item.
+        * \returns the awaitable.
+        */
+        awaitable_push push(T value) noexcept {
+            awaitable_push awaitable{ {}, this };
+            awaitable.m_waiter.m_value.emplace(std::move(value));
+            return awaitable;
+        }
+
+        /**
+        * \brief Take the oldest item from the channel, use as co_await pop().
+        * \returns the awaitable.
+        */
+        awaitable_pop pop() noexcept {
+            return awaitable_pop{ {}, this };
+        }
+
+        /**
+        * \brief Put an item into the channel without waiting. Can be used outside of coros.
+        * \param[in] value The item.
+        * \returns true if the item was taken, false if the channel is full or closed.
+        */
+        bool try_push(T value) noexcept {
+            waiter_t* woken = nullptr;
+            lock();
+            bool ok = !m_closed && push_locked(value, woken);
+            unlock();
+            wake(woken);
+            return ok;
+        }
+
+        /**
+        * \brief Take the oldest item without waiting. Can be used outside of coros.
+        * \returns the item, or nothing if the channel is empty.
+        */
+        std::optional<T> try_pop() noexcept {
+            std::optional<T> value;
+            waiter_t* woken = nullptr;
+            lock();
+            pop_locked(value, woken);
+            unlock();
+            wake(woken);
+            return value;
+        }
+
+        /**
+        * \brief Close the channel. Waiting producers get false, waiting consumers get nothing.
+        */
+        void close() noexcept {
+            lock();
+            m_closed = true;
+            waiter_t* pushers = m_pushers.m_head;
+            waiter_t* poppers = m_poppers.m_head;
+            m_pushers = {};
+            m_poppers = {};
+            unlock();
+            for (waiter_t* list : { pushers, poppers }) {
+                while (list != nullptr) {
+                    waiter_t* next = list->m_next;  //the waiter is gone when its coro runs
+                    wake(list);
+                    list = next;
+                }
+            }
+        }
+
+        /**
+        * \brief Test whether the channel has been closed.
+        * \returns true if the channel has been closed.
+        */
+        bool is_closed() noexcept {
+            lock();
+            bool closed = m_closed;
+            unlock();
+            return closed;
+        }
+    };
+
+
+    template<typename U>
+    struct coro_value { using type = U; };          //the value type of a stage result, unwraps Coro<U>
+
+    template<typename U>
+    struct coro_value<Coro<U>> { using type = U; };
+
+    template<typename F, typename T>
+    using stage_value_t = typename coro_value<std::invoke_result_t<F&, T&&>>::type;
+
+    /**
+    * \brief First pipeline stage, pushes the items of the source until it returns nothing.
+    * \param[in] source Returns std::optional<T>, or a Coro thereof.
+    * \param[in] out The output channel.
+    */
+    template<typename S, typename T>
+    Coro<> source_stage(S& source, Channel<T>& out) {
+        while (true) {
+            std::optional<T> item;
+            if constexpr (CORO<std::invoke_result_t<S&>>) item = co_await source();
+            else item = source();
+            if (!item || !co_await out.push(std::move(*item))) break;
+        }
+        out.close();
+        co_return;
+    }
+
+    /**
+    * \brief Middle pipeline stage, transforms each item of the input channel into an item of the output channel.
+    * \param[in] f The stage function.
+    * \param[in] in The input channel.
+    * \param[in] out The output channel.
+    */
+    template<typename F, typename T, typename U>
+    Coro<> transform_stage(F& f, Channel<T>& in, Channel<U>& out) {
+        while (std::optional<T> item = co_await in.pop()) {
+            std::optional<U> result;
+            if constexpr (CORO<std::invoke_result_t<F&, T&&>>) result.emplace(co_await f(std::move(*item)));
+            else result.emplace(f(std::move(*item)));
+            if (!co_await out.push(std::move(*result))) {
+                in.close();             //downstream stopped, so stop upstream too
+                break;
+            }
+        }
+        out.close();
+        co_return;
+    }
+
+    /**
+    * \brief Last pipeline stage, consumes the items of the input channel.
+    * \param[in] f The stage function.
+    * \param[in] in The input channel.
+    */
+    template<typename F, typename T>
+    Coro<> sink_stage(F& f, Channel<T>& in) {
+        while (std::optional<T> item = co_await in.pop()) {
+            if constexpr (CORO<std::invoke_result_t<F&, T&&>>) co_await f(std::move(*item));
+            else f(std::move(*item));
+        }
+        co_return;
+    }
+
+    template<typename T, typename... Fs>
+    struct pipeline_channels { using type = std::tuple<>; };    //channels between the stages
+
+    template<typename T, typename F, typename... Fs>
+    struct pipeline_channels<T, F, Fs...> {
+        using type = decltype(std::tuple_cat(std::declval<std::tuple<std::unique_ptr<Channel<T>>>>()
+            , std::declval<typename pipeline_channels<stage_value_t<F, T>, Fs...>::type>()));
+    };
+
+    template<typename T, typename F>
+    struct pipeline_channels<T, F> { using type = std::tuple<std::unique_ptr<Channel<T>>>; };
+
+    /**
+    * \brief Run the stages of a pipeline.
+    * \param[in] source The source.
+    * \param[in] stages The other stages.
+    * \param[in] channels The channels between the stages.
+    */
+    template<typename S, typename Tuple, typename Channels, std::size_t... Idx>
+    Coro<> run_pipeline(S& source, Tuple& stages, Channels& channels, std::index_sequence<Idx...>) {
+        constexpr std::size_t last = sizeof...(Idx);
+        co_await parallel(source_stage(source, *std::get<0>(channels))
+            , transform_stage(std::get<Idx>(stages), *std::get<Idx>(channels), *std::get<Idx + 1>(channels))...
+            , sink_stage(std::get<last>(stages), *std::get<last>(channels)));
+        co_return;
+    }
+
+    /**
+    * \brief Run a streaming pipeline, each stage running as its own coro, connected by bounded channels.
+    *
+    * The source is called until it returns nothing, each middle stage transforms an item into the item
+    * for the next stage, and the sink consumes the items. Stages run in parallel on any threads, and each
+    * stage handles its items in order. A full channel suspends the stage in front of it, so at most
+    * capacity items wait between two stages. Stage functions can return Coros, which are awaited.
+    *
+    * \param[in] capacity Capacity of each channel.
+    * \param[in] source Returns std::optional<T>, or a Coro thereof.
+    * \param[in] stages Middle stages getting T&& and returning the item of the next stage, and the sink getting the last items.
+    * \returns a Coro that finishes when all stages have finished.
+    */
+    template<typename S, typename... Fs>
+    requires (sizeof...(Fs) > 0)
+    Coro<> pipeline(std::size_t capacity, S source, Fs... stages) {
+        using T = typename coro_value<std::invoke_result_t<S&>>::type::value_type;
+        using channels_t = typename pipeline_channels<T, Fs...>::type;
+
+        auto functions = std::make_tuple(std::move(stages)...);
+        channels_t channels;
+        auto make = [&]<std::size_t... Idx>(std::index_sequence<Idx...>) {
+            ((std::get<Idx>(channels) = std::make_unique<typename std::tuple_element_t<Idx, channels_t>::element_type>(capacity)), ...);
+        };
+        make(std::make_index_sequence<sizeof...(Fs)>{});    //channel i is the input of stage i
+        co_await run_pipeline(source, functions, channels, std::make_index_sequence<sizeof...(Fs) - 1>{});
+        co_return;
+    }
+
 }
 
 
@@ -0,0 +1,724 @@
+#ifndef VGJSIO_H
+#define VGJSIO_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <concepts>
+
+#include "VGJS.h"
+#include "VGJSCoro.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define VGJS_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/syscall.h>
+#endif
+
+#if defined(_WIN32)
+    #if defined(_MSC_VER)
+        #pragma comment(lib, "ws2_32.lib")
+    #endif
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <cerrno>
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <sys/mman.h>
+#endif
+
+
+namespace vgjs {
+
+#if defined(_WIN32)
+    using io_handle_t = HANDLE;     ///<file handle, or a SOCKET for recv() and send()
+#else
+    using io_handle_t = int;        ///<file descriptor, files and sockets alike
+#endif
+
+    enum class io_op_t {
+        read,       ///<read from a file at an offset
+        write,      ///<write to a file at an offset
+        recv,       ///<receive from a socket
+        send        ///<send to a socket
+    };
+
+    /**
+    * \brief One I/O operation. Lives in the awaitable, i.e. in the frame of the coro that waits for it.
+    */
+    struct io_request_t {
+        io_op_t         m_op = io_op_t::read;
+        io_handle_t     m_handle{};
+        void*           m_buffer = nullptr;
+        uint32_t        m_size = 0;
+        uint64_t        m_offset = 0;       ///<file offset, ignored for sockets
+        int64_t         m_result = 0;       ///<bytes transferred, or a negative error code
+        Job_base*       m_job = nullptr;    ///<the coro to reschedule when the operation has completed
+        io_request_t*   m_next = nullptr;   ///<for queueing requests in the backend
+    };
+
+
+    /**
+    * \brief Backend thread that runs I/O operations for coros, so worker threads never block in the kernel.
+    *
+    * On Linux the operations are submitted to an io_uring, and the backend thread waits for their completion.
+    * Elsewhere, or if the kernel does not allow io_uring, the backend thread runs the operations one after the
+    * other with blocking calls. In both cases the waiting coro is rescheduled into the job system when its
+    * operation has completed.
+    */
+    class IoService {
+        static inline const uint32_t c_entries = 256;      ///<size of the submission queue
+
+        std::mutex      m_mutex;                ///<protects submission
+        std::condition_variable m_cv;           ///<wakes up the blocking backend
+        std::thread     m_thread;               ///<backend thread
+        io_request_t*   m_head = nullptr;       ///<requests that have not been submitted yet
+        io_request_t*   m_tail = nullptr;
+        bool            m_stop = false;         ///<blocking backend: leave the loop
+
+        /**
+        * \brief Reschedule the coro that waits for a request. The request must not be touched afterwards.
+        * \param[in] request The completed request.
+        */
+        void complete(io_request_t* request) noexcept {
+            JobSystem().schedule_job(request->m_job);
+        }
+
+        /**
+        * \brief Append a request to the list of requests that wait for submission.
+        * \param[in] request The request.
+        */
+        void push(io_request_t* request) noexcept {
+            request->m_next = nullptr;
+            if (m_tail == nullptr) m_head = request; else m_tail->m_next = request;
+            m_tail = request;
+        }
+
+        /**
+        * \brief Take the first request from the list of requests that wait for submission.
+        * \returns the request, or nullptr if the list is empty.
+        */
+        io_request_t* pop() noexcept {
+            io_request_t* request = m_head;
+            if (request != nullptr) {
+                m_head = request->m_next;
+                if (m_head == nullptr) m_tail = nullptr;
+            }
+            return request;
+        }
+
+        /**
+        * \brief Run an operation with a blocking call.
+        * \param[in] request The request to run.
+        */
+        static void perform(io_request_t* request) noexcept {
+#if defined(_WIN32)
+            if (request->m_op == io_op_t::recv || request->m_op == io_op_t::send) {
+                SOCKET s = (SOCKET)request->m_handle;
+                int n = request->m_op == io_op_t::recv
+                    ? ::recv(s, (char*)request->m_buffer, (int)request->m_size, 0)
+                    : ::send(s, (const char*)request->m_buffer, (int)request->m_size, 0);
+                request->m_result = n == SOCKET_ERROR ? -(int64_t)WSAGetLastError() : n;
+                return;
+            }
+            OVERLAPPED overlapped{};
+            overlapped.Offset = (DWORD)(request->m_offset & 0xffffffff);
+            overlapped.OffsetHigh = (DWORD)(request->m_offset >> 32);
+            DWORD bytes = 0;
+            BOOL ok = request->m_op == io_op_t::read
+                ? ReadFile(request->m_handle, request->m_buffer, request->m_size, &bytes, &overlapped)
+                : WriteFile(request->m_handle, request->m_buffer, request->m_size, &bytes, &overlapped);
+            if (!ok && GetLastError() == ERROR_HANDLE_EOF) ok = TRUE;   //reading at the end of the file
+            request->m_result = ok ? (int64_t)bytes : -(int64_t)GetLastError();
+#else
+            ssize_t n = 0;
+            do {
+                switch (request->m_op) {
+                case io_op_t::read:  n = ::pread(request->m_handle, request->m_buffer, request->m_size, (off_t)request->m_offset); break;
+                case io_op_t::write: n = ::pwrite(request->m_handle, request->m_buffer, request->m_size, (off_t)request->m_offset); break;
+                case io_op_t::recv:  n = ::recv(request->m_handle, request->m_buffer, request->m_size, 0); break;
+                case io_op_t::send:  n = ::send(request->m_handle, request->m_buffer, request->m_size, 0); break;
+                }
+            } while (n < 0 && errno == EINTR);
+            request->m_result = n < 0 ? -(int64_t)errno : (int64_t)n;
+#endif
+        }
+
+        /**
+        * \brief Loop of the blocking backend thread.
+        */
+        void run_blocking() noexcept {
+            while (true) {
+                io_request_t* request = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv.wait(lock, [&]() { return m_stop || m_head != nullptr; });
+                    if (m_head == nullptr) return;      //stop only when all requests are done
+                    request = pop();
+                }
+                perform(request);
+                complete(request);
+            }
+        }
+
+#if defined(VGJS_IO_URING)
+        int             m_ring = -1;            ///<io_uring file descriptor, or -1 if the blocking backend is used
+        io_uring_params m_params{};
+        void*           m_sq_ptr = nullptr;     ///<mapped submission queue ring
+        void*           m_cq_ptr = nullptr;     ///<mapped completion queue ring
+        std::size_t     m_sq_size = 0;
+        std::size_t     m_cq_size = 0;
+        io_uring_sqe*   m_sqes = nullptr;       ///<mapped submission queue entries
+        uint32_t        m_in_flight = 0;        ///<submitted but not yet completed, at most the size of the completion queue
+
+        unsigned* sq(uint32_t off) noexcept { return (unsigned*)((char*)m_sq_ptr + off); }
+        unsigned* cq(uint32_t off) noexcept { return (unsigned*)((char*)m_cq_ptr + off); }
+
+        /**
+        * \brief Create the io_uring and map its rings.
+        * \returns true if the io_uring can be used.
+        */
+        bool setup_ring() noexcept {
+            int fd = (int)syscall(__NR_io_uring_setup, c_entries, &m_params);
+            if (fd < 0) return false;
+            m_sq_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+            m_cq_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (m_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+            m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            m_cq_ptr = single ? m_sq_ptr : mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            void* sqes = mmap(nullptr, m_params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (m_sq_ptr == MAP_FAILED || m_cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+                if (m_sq_ptr != MAP_FAILED) munmap(m_sq_ptr, m_sq_size);
+                if (!single && m_cq_ptr != MAP_FAILED) munmap(m_cq_ptr, m_cq_size);
+                if (sqes != MAP_FAILED) munmap(sqes, m_params.sq_entries * sizeof(io_uring_sqe));
+                ::close(fd);
+                return false;
+            }
+            m_sqes = (io_uring_sqe*)sqes;
+            m_ring = fd;
+            return true;
+        }
+
+        /**
+        * \brief Unmap the rings and close the io_uring.
+        */
+        void release_ring() noexcept {
+            munmap(m_sqes, m_params.sq_entries * sizeof(io_uring_sqe));
+            if (m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_size);
+            munmap(m_sq_ptr, m_sq_size);
+            ::close(m_ring);
+            m_ring = -1;
+        }
+
+        /**
+        * \brief Put a request into the submission queue. Call only with m_mutex locked.
+        * \param[in] request The request, or nullptr for the operation that stops the backend thread.
+        */
+        void push_sqe(io_request_t* request) noexcept {
+            unsigned tail = std::atomic_ref<unsigned>(*sq(m_params.sq_off.tail)).load(std::memory_order::relaxed);
+            unsigned idx = tail & *sq(m_params.sq_off.ring_mask);
+            io_uring_sqe& sqe = m_sqes[idx];
+            std::memset(&sqe, 0, sizeof(sqe));
+            if (request == nullptr) {
+                sqe.opcode = IORING_OP_NOP;
+            }
+            else {
+                switch (request->m_op) {
+                case io_op_t::read:  sqe.opcode = IORING_OP_READ; break;
+                case io_op_t::write: sqe.opcode = IORING_OP_WRITE; break;
+                case io_op_t::recv:  sqe.opcode = IORING_OP_RECV; break;
+                case io_op_t::send:  sqe.opcode = IORING_OP_SEND; break;
+                }
+                sqe.fd = request->m_handle;
+                sqe.addr = (uint64_t)request->m_buffer;
+                sqe.len = request->m_size;
+                sqe.off = (request->m_op == io_op_t::read || request->m_op == io_op_t::write) ? request->m_offset : 0;
+            }
+            sqe.user_data = (uint64_t)request;
+            sq(m_params.sq_off.array)[idx] = idx;
+            std::atomic_ref<unsigned>(*sq(m_params.sq_off.tail)).store(tail + 1, std::memory_order::release);
+            ++m_in_flight;
+        }
+
+        /**
+        * \brief Tell the kernel about new submission queue entries. Call only with m_mutex locked.
+        * \param[in] num Number of new entries.
+        */
+        void enter(uint32_t num) noexcept {
+            while (num > 0) {
+                int n = (int)syscall(__NR_io_uring_enter, m_ring, num, 0, 0, nullptr, 0);
+                if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    std::cout << "io_uring_enter failed " << errno << "\n";
+                    std::terminate();
+                }
+                if (n > 0) num -= n;
+            }
+        }
+
+        /**
+        * \brief Submit requests that had to wait because the completion queue was full. Call only with m_mutex locked.
+        */
+        void submit_waiting() noexcept {
+            uint32_t num = 0;
+            while (m_head != nullptr && m_in_flight < m_params.cq_entries) {
+                push_sqe(pop());
+                if (++num == m_params.sq_entries) {     //submission queue is full
+                    enter(num);
+                    num = 0;
+                }
+            }
+            enter(num);
+        }
+
+        /**
+        * \brief Loop of the io_uring backend thread: wait for completions and reschedule their coros.
+        */
+        void run_ring() noexcept {
+            unsigned* head_ptr = cq(m_params.cq_off.head);
+            unsigned* tail_ptr = cq(m_params.cq_off.tail);
+            unsigned mask = *cq(m_params.cq_off.ring_mask);
+            io_uring_cqe* cqes = (io_uring_cqe*)cq(m_params.cq_off.cqes);
+            bool stop = false;
+
+            while (true) {
+                syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);  //wait for at least one completion
+
+                unsigned head = std::atomic_ref<unsigned>(*head_ptr).load(std::memory_order::relaxed);
+                unsigned tail = std::atomic_ref<unsigned>(*tail_ptr).load(std::memory_order::acquire);
+                uint32_t num = tail - head;
+                for (; head != tail; ++head) {
+                    io_uring_cqe& cqe = cqes[head & mask];
+                    io_request_t* request = (io_request_t*)cqe.user_data;
+                    if (request == nullptr) {
+                        stop = true;        //the destructor wants the thread to leave
+                        continue;
+                    }
+                    request->m_result = cqe.res;
+                    complete(request);
+                }
+                std::atomic_ref<unsigned>(*head_ptr).store(head, std::memory_order::release);
+
+                if (num > 0) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_in_flight -= num;
+                    submit_waiting();
+                    if (stop && m_in_flight == 0) return;   //leave only when all requests are done
+                }
+            }
+        }
+#endif
+
+    public:
+
+        /**
+        * \brief Constructor, starts the backend thread.
+        */
+        IoService() noexcept {
+#if defined(VGJS_IO_URING)
+            if (setup_ring()) {
+                m_thread = std::thread(&IoService::run_ring, this);
+                return;
+            }
+#endif
+            m_thread = std::thread(&IoService::run_blocking, this);
+        }
+
+        IoService(const IoService&) = delete;
+
+        /**
+        * \brief Destructor, stops the backend thread after all submitted requests have been completed.
+        */
+        ~IoService() {
+#if defined(VGJS_IO_URING)
+            if (m_ring >= 0) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    push_sqe(nullptr);      //the backend thread leaves when it sees this
+                    enter(1);
+                }
+                m_thread.join();
+                release_ring();
+                return;
+            }
+#endif
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_cv.notify_one();
+            m_thread.join();
+        }
+
+        /**
+        * \brief Start an I/O operation. The coro in request->m_job is rescheduled when it has completed.
+        * \param[in] request The operation, must stay valid until it has completed.
+        */
+        void submit(io_request_t* request) noexcept {
+            std::lock_guard<std::mutex> lock(m_mutex);
+#if defined(VGJS_IO_URING)
+            if (m_ring >= 0) {
+                if (m_head != nullptr || m_in_flight >= m_params.cq_entries) {
+                    push(request);          //the completion queue is full, wait for completions
+                    return;
+                }
+                push_sqe(request);
+                enter(1);
+                return;
+            }
+#endif
+            push(request);
+            m_cv.notify_one();
+        }
+
+        /**
+        * \brief Test which backend is used.
+        * \returns true if I/O goes through io_uring, false if the backend thread blocks.
+        */
+        bool is_async() const noexcept {
+#if defined(VGJS_IO_URING)
+            return m_ring >= 0;
+#else
+            return false;
+#endif
+        }
+    };
+
+    /**
+    * \brief Get the I/O backend, it is started when it is first used.
+    * \returns the I/O backend.
+    */
+    inline IoService& io_service() noexcept {
+        static IoService service;
+        return service;
+    }
+
+
+    /**
+    * \brief Awaitable for an I/O operation. Suspends the coro until the backend has completed the operation.
+    */
+    struct awaitable_io : awaitable_external {
+        io_request_t m_request;     ///<the operation
+
+        bool await_ready() noexcept { return m_request.m_size == 0; }  ///<nothing to transfer
+
+        /**
+        * \brief Hand the operation to the backend, which reschedules the coro when it has completed.
+        * \param[in] h The coro handle, can be used to get the promise.
+        */
+        template<typename P>
+        void await_suspend(n_exp::coroutine_handle<P> h) noexcept {
+            m_request.m_job = &h.promise();
+            io_service().submit(&m_request);    //the coro may already run again when this returns
+        }
+
+        /**
+        * \brief Get the result of the operation.
+        * \returns the number of bytes transferred, or a negative error code.
+        */
+        int64_t await_resume() noexcept { return m_request.m_result; }
+
+        /**
+        * \brief Awaiter constructor.
+        * \param[in] op The kind of operation.
+        * \param[in] handle The file or socket.
+        * \param[in] buffer The data.
+        * \param[in] size Number of bytes. At most UINT32_MAX bytes are transferred at once, larger buffers
+        *                 result in a short transfer.
+        * \param[in] offset File offset.
+        */
+        awaitable_io(io_op_t op, io_handle_t handle, void* buffer, std::size_t size, uint64_t offset) noexcept
+            : m_request{ op, handle, buffer, (uint32_t)std::min<std::size_t>(size, UINT32_MAX), offset } {};
+    };
+
+    /**
+    * \brief Read from a file without blocking the worker thread, use as co_await read(...).
+    * \param[in] handle The file.
+    * \param[in] buffer Receives the data.
+    * \param[in] offset Position in the file.
+    * \returns the awaitable, co_await returns the number of bytes read, or a negative error code.
+    */
+    inline awaitable_io read(io_handle_t handle, std::span<std::byte> buffer, uint64_t offset) noexcept {
+        return { io_op_t::read, handle, buffer.data(), buffer.size(), offset };
+    }
+
+    /**
+    * \brief Write to a file without blocking the worker thread, use as co_await write(...).
+    * \param[in] handle The file.
+    * \param[in] buffer The data to write.
+    * \param[in] offset Position in the file.
+    * \returns the awaitable, co_await returns the number of bytes written, or a negative error code.
+    */
+    inline awaitable_io write(io_handle_t handle, std::span<const std::byte> buffer, uint64_t offset) noexcept {
+        return { io_op_t::write, handle, (void*)buffer.data(), buffer.size(), offset };
+    }
+
+    /**
+    * \brief Receive from a socket without blocking the worker thread, use as co_await recv(...).
+    * \param[in] handle The socket.
+    * \param[in] buffer Receives the data.
+    * \returns the awaitable, co_await returns the number of bytes received, or a negative error code.
+    */
+    inline awaitable_io recv(io_handle_t handle, std::span<std::byte> buffer) noexcept {
+        return { io_op_t::recv, handle, buffer.data(), buffer.size(), 0 };
+    }
+
+    /**
+    * \brief Send to a socket without blocking the worker thread, use as co_await send(...).
+    * \param[in] handle The socket.
+    * \param[in] buffer The data to send.
+    * \returns the awaitable, co_await returns the number of bytes sent, or a negative error code.
+    */
+    inline awaitable_io send(io_handle_t handle, std::span<const std::byte> buffer) noexcept {
+        return { io_op_t::send, handle, (void*)buffer.data(), buffer.size(), 0 };
+    }
+
+    /**
+    * \brief Open a file for use with read() and write().
+    * \param[in] path Path of the file.
+    * \param[in] writable If true the file is created or truncated and opened for reading and writing, else opened for reading.
+    * \returns the handle, or an invalid handle (see io_valid()) if the file could not be opened.
+    */
+    inline io_handle_t io_open(const std::string& path, bool writable = false) noexcept {
+#if defined(_WIN32)
+        return CreateFileA(path.c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, nullptr
+            , writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        return ::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+#endif
+    }
+
+    /**
+    * \brief Test whether a file could be opened.
+    * \param[in] handle The handle returned by io_open().
+    * \returns true if the handle is valid.
+    */
+    inline bool io_valid(io_handle_t handle) noexcept {
+#if defined(_WIN32)
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        return handle >= 0;
+#endif
+    }
+
+    /**
+    * \brief Close a file that was opened with io_open().
+    * \param[in] handle The file.
+    */
+    inline void io_close(io_handle_t handle) noexcept {
+#if defined(_WIN32)
+        CloseHandle(handle);
+#else
+        ::close(handle);
+#endif
+    }
+
+
+    //---------------------------------------------------------------------------------------------------
+    //memory mapped file processing
+
+    /**
+    * \brief A file that is mapped read-only into memory.
+    */
+    class MappedFile {
+        const char*     m_data = nullptr;   ///<first byte of the file
+        std::size_t     m_size = 0;         ///<size of the file in bytes
+        bool            m_open = false;
+#if defined(_WIN32)
+        HANDLE          m_file = INVALID_HANDLE_VALUE;
+        HANDLE          m_mapping = nullptr;
+#endif
+
+    public:
+
+        /**
+        * \brief Map a file into memory.
+        * \param[in] path Path of the file.
+        */
+        MappedFile(const std::string& path) noexcept {
+#if defined(_WIN32)
+            m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE) return;
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(m_file, &size)) return;
+            m_size = (std::size_t)size.QuadPart;
+            m_open = true;
+            if (m_size == 0) return;
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (m_mapping != nullptr) m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+            if (m_data == nullptr) m_open = false;
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            off_t size = ::lseek(fd, 0, SEEK_END);
+            if (size >= 0) {
+                m_size = (std::size_t)size;
+                m_open = true;
+                if (m_size > 0) {
+                    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (p == MAP_FAILED) m_open = false;
+                    else {
+                        m_data = (const char*)p;
+                        madvise(p, m_size, MADV_SEQUENTIAL);    //read ahead
+                    }
+                }
+            }
+            ::close(fd);        //the mapping stays valid
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+
+        /**
+        * \brief Destructor, unmaps the file.
+        */
+        ~MappedFile() {
+#if defined(_WIN32)
+            if (m_data != nullptr) UnmapViewOfFile(m_data);
+            if (m_mapping != nullptr) CloseHandle(m_mapping);
+            if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+            if (m_data != nullptr) munmap((void*)m_data, m_size);
+#endif
+        }
+
+        bool            is_open() const noexcept { return m_open; }     ///<true if the file could be mapped
+        const char*     data() const noexcept { return m_data; }        ///<first byte of the file
+        std::size_t     size() const noexcept { return m_size; }        ///<size of the file in bytes
+
+        /**
+        * \brief Tell the OS that a part of the file is not needed anymore, so its pages can be dropped.
+        * Reading the part again is allowed, it is then read from the file once more.
+        * \param[in] offset Offset of the part.
+        * \param[in] size Size of the part.
+        */
+        void release(std::size_t offset, std::size_t size) noexcept {
+#if !defined(_WIN32)
+            static const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+            std::size_t begin = (offset + page - 1) / page * page;          //only whole pages
+            std::size_t end = std::min(offset + size, m_size) / page * page;
+            if (end > begin) madvise((void*)(m_data + begin), end - begin, MADV_DONTNEED);
+#endif
+        }
+    };
+
+
+    /**
+    * \brief Options for process_file().
+    */
+    struct file_pipeline_t {
+        std::size_t m_chunk_size = 1 << 20;     ///<approximate size of a chunk in bytes
+        uint32_t    m_in_flight = 16;           ///<max number of chunks that are parsed or wait for the consumer
+        char        m_delimiter = '\n';         ///<chunks end after a delimiter
+        std::size_t m_record_size = 0;          ///<if > 0, records have this fixed size and the delimiter is ignored
+    };
+
+    /**
+    * \brief Feed the results of one wave of chunks in order to the consumer.
+    * \param[in] consume The consumer, can return a Coro that is awaited.
+    * \param[in] results The results of the chunks.
+    * \param[in] num Number of results.
+    */
+    template<typename C, typename R>
+    Coro<> consume_chunks(C& consume, std::vector<std::optional<R>>& results, std::size_t num) {
+        for (std::size_t i = 0; i < num; ++i) {
+            if constexpr (CORO<std::invoke_result_t<C&, R&&>>) {
+                co_await consume(std::move(*results[i]));
+            }
+            else {
+                consume(std::move(*results[i]));
+            }
+            results[i].reset();
+        }
+        co_return;
+    }
+
+    /**
+    * \brief Process a large file in parallel without copying it, with bounded memory.
+    *
+    * The file is mapped into memory and split into chunks that end at a record boundary. Each chunk is
+    * parsed by its own Job, and the results are handed to the consumer in file order. Chunks are processed
+    * in waves of m_in_flight/2 chunks: while one wave is parsed, the results of the previous wave are
+    * consumed. So at most m_in_flight chunks are parsed or wait for the consumer, and the pages of consumed
+    * chunks are given back to the OS, no matter how big the file is.
+    *
+    * \param[in] path Path of the file.
+    * \param[in] parse Called as parse(std::string_view chunk) in parallel, returns the result of the chunk.
+    * \param[in] consume Called as consume(R&& result) for each chunk in file order, one after the other. Can return a Coro.
+    * \param[in] options Chunk size, number of chunks in flight, how records end.
+    * \returns the number of chunks, or -1 if the file could not be mapped.
+    */
+    template<typename P, typename C>
+    requires std::invocable<P&, std::string_view>
+    Coro<int64_t> process_file(std::string path, P parse, C consume, file_pipeline_t options = file_pipeline_t{}) {
+        using R = std::invoke_result_t<P&, std::string_view>;
+
+        MappedFile file(path);
+        if (!file.is_open()) co_return -1;
+
+        const std::size_t wave = std::max(1u, options.m_in_flight / 2);   //chunks per wave
+        std::size_t chunk_size = std::max<std::size_t>(options.m_chunk_size, 1);
+        if (options.m_record_size > 0) {
+            chunk_size = std::max(chunk_size / options.m_record_size, (std::size_t)1) * options.m_record_size;
+        }
+
+        std::vector<std::string_view> chunks[2];                //chunks of the current and the previous wave
+        std::vector<std::optional<R>> results[2]{ std::vector<std::optional<R>>(wave), std::vector<std::optional<R>>(wave) };
+        std::size_t first[2] = { 0, 0 };                        //offset of the first chunk of a wave
+        n_pmr::vector<Function> jobs;
+        jobs.reserve(wave);
+        std::size_t pos = 0;
+        int64_t num = 0;
+        int cur = 0;
+
+        while (true) {
+            chunks[cur].clear();                                //cut the next wave
+            first[cur] = pos;
+            while (chunks[cur].size() < wave && pos < file.size()) {
+                std::size_t end = std::min(pos + chunk_size, file.size());
+                if (options.m_record_size == 0 && end < file.size()) {       //end after the next delimiter
+                    const void* p = std::memchr(file.data() + end - 1, options.m_delimiter, file.size() - end + 1);
+                    end = p == nullptr ? file.size() : (std::size_t)((const char*)p - file.data()) + 1;
+                }
+                chunks[cur].emplace_back(file.data() + pos, end - pos);
+                pos = end;
+            }
+
+            jobs.clear();
+            for (std::size_t i = 0; i < chunks[cur].size(); ++i) {
+                jobs.emplace_back([&, i, cur]() { results[cur][i].emplace(parse(chunks[cur][i])); });
+            }
+
+            const int prev = 1 - cur;
+            const std::size_t num_prev = chunks[prev].size();
+            if (jobs.empty() && num_prev == 0) break;           //all chunks consumed
+
+            if (num_prev > 0) {
+                co_await parallel(jobs, consume_chunks(consume, results[prev], num_prev)); //parse this wave, consume the previous one
+                file.release(first[prev], first[cur] - first[prev]);
+                num += num_prev;
+                chunks[prev].clear();
+            }
+            else {
+                co_await jobs;
+            }
+            cur = prev;
+        }
+        co_return num;
+    }
+
+}
+
+
+#endif
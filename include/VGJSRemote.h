@@ -0,0 +1,1061 @@
+#ifndef VGJSREMOTE_H
+#define VGJSREMOTE_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <span>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <concepts>
+#include <type_traits>
+
+#include "VGJS.h"
+#include "VGJSCoro.h"
+
+#if defined(_WIN32)
+    //winsock2.h comes from VGJS.h, it must be included before windows.h
+    #if defined(_MSC_VER)
+        #pragma comment(lib, "ws2_32.lib")
+    #endif
+#else
+    #include <unistd.h>
+    #include <cerrno>
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <netdb.h>
+#endif
+
+
+namespace vgjs {
+
+    //---------------------------------------------------------------------------------------------------
+    //sockets
+
+#if defined(_WIN32)
+    using socket_t = SOCKET;
+    inline const socket_t c_invalid_socket = INVALID_SOCKET;
+#else
+    using socket_t = int;
+    inline const socket_t c_invalid_socket = -1;
+#endif
+
+    /**
+    * \brief Start the socket library once, only needed on Windows.
+    * \returns true if sockets can be used.
+    */
+    inline bool net_startup() noexcept {
+#if defined(_WIN32)
+        static bool ok = []() { WSADATA data; return WSAStartup(MAKEWORD(2, 2), &data) == 0; }();
+        return ok;
+#else
+        return true;
+#endif
+    }
+
+    /**
+    * \brief Stop sending and receiving, threads blocking on the socket return.
+    * \param[in] s The socket.
+    */
+    inline void net_shutdown(socket_t s) noexcept {
+#if defined(_WIN32)
+        ::shutdown(s, SD_BOTH);
+#else
+        ::shutdown(s, SHUT_RDWR);
+#endif
+    }
+
+    /**
+    * \brief Close a socket.
+    * \param[in] s The socket.
+    */
+    inline void net_close(socket_t s) noexcept {
+#if defined(_WIN32)
+        ::closesocket(s);
+#else
+        ::close(s);
+#endif
+    }
+
+    /**
+    * \brief Send a buffer completely, blocking.
+    * \param[in] s The socket.
+    * \param[in] data The data.
+    * \param[in] size Number of bytes.
+    * \returns true if all bytes were sent.
+    */
+    inline bool net_send_all(socket_t s, const std::byte* data, std::size_t size) noexcept {
+#if defined(MSG_NOSIGNAL)
+        const int flags = MSG_NOSIGNAL;     //a closed peer must not kill the process
+#else
+        const int flags = 0;
+#endif
+        while (size > 0) {
+            auto n = ::send(s, (const char*)data, (int)std::min<std::size_t>(size, 1 << 30), flags);
+#if !defined(_WIN32)
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n <= 0) return false;
+            data += n;
+            size -= (std::size_t)n;
+        }
+        return true;
+    }
+
+    /**
+    * \brief Fill a buffer completely, blocking.
+    * \param[in] s The socket.
+    * \param[in] data Receives the data.
+    * \param[in] size Number of bytes.
+    * \returns true if all bytes were received, false if the peer closed the connection or on error.
+    */
+    inline bool net_recv_all(socket_t s, std::byte* data, std::size_t size) noexcept {
+        while (size > 0) {
+            auto n = ::recv(s, (char*)data, (int)std::min<std::size_t>(size, 1 << 30), 0);
+#if !defined(_WIN32)
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n <= 0) return false;
+            data += n;
+            size -= (std::size_t)n;
+        }
+        return true;
+    }
+
+    /**
+    * \brief Turn off Nagle's algorithm, batches are sent as soon as they are ready.
+    * \param[in] s The socket.
+    */
+    inline void net_no_delay(socket_t s) noexcept {
+        int one = 1;
+        ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    }
+
+    /**
+    * \brief Connect to a server.
+    * \param[in] host Name or address of the server.
+    * \param[in] port Port of the server.
+    * \returns the connected socket, or c_invalid_socket.
+    */
+    inline socket_t net_connect(const std::string& host, uint16_t port) noexcept {
+        if (!net_startup()) return c_invalid_socket;
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* list = nullptr;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list) != 0) return c_invalid_socket;
+
+        socket_t s = c_invalid_socket;
+        for (addrinfo* ai = list; ai != nullptr; ai = ai->ai_next) {
+            s = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (s == c_invalid_socket) continue;
+            if (::connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) break;
+            net_close(s);
+            s = c_invalid_socket;
+        }
+        ::freeaddrinfo(list);
+        if (s != c_invalid_socket) net_no_delay(s);
+        return s;
+    }
+
+    /**
+    * \brief Create a socket that accepts connections.
+    * \param[in] address The local address to listen on, e.g. "127.0.0.1", or "" for all interfaces.
+    * \param[in] port The port, 0 lets the OS choose a free one.
+    * \param[out] bound The port that is actually used.
+    * \returns the listening socket, or c_invalid_socket.
+    */
+    inline socket_t net_listen(const std::string& address, uint16_t port, uint16_t& bound) noexcept {
+        if (!net_startup()) return c_invalid_socket;
+        addrinfo hints{};
+        hints.ai_family = address.empty() ? AF_INET : AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+        addrinfo* list = nullptr;
+        if (::getaddrinfo(address.empty() ? nullptr : address.c_str(), std::to_string(port).c_str(), &hints, &list) != 0) return c_invalid_socket;
+
+        socket_t s = c_invalid_socket;
+        for (addrinfo* ai = list; ai != nullptr; ai = ai->ai_next) {
+            s = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (s == c_invalid_socket) continue;
+            int one = 1;
+            ::setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+            if (::bind(s, ai->ai_addr, (int)ai->ai_addrlen) == 0 && ::listen(s, 64) == 0) break;
+            net_close(s);
+            s = c_invalid_socket;
+        }
+        ::freeaddrinfo(list);
+        if (s == c_invalid_socket) return s;
+
+        sockaddr_storage addr{};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(s, (sockaddr*)&addr, &len) != 0) {
+            net_close(s);
+            return c_invalid_socket;
+        }
+        bound = ntohs(addr.ss_family == AF_INET6 ? ((sockaddr_in6*)&addr)->sin6_port : ((sockaddr_in*)&addr)->sin_port);
+        return s;
+    }
+
+
+    //---------------------------------------------------------------------------------------------------
+    //wire format
+
+    using remote_bytes_t = std::vector<std::byte>;     ///<serialized arguments or results
+
+    inline const int32_t remote_ok = 0;                 ///<the function ran and returned a result
+    inline const int32_t remote_unknown_function = -1;  ///<no function is registered for the type on the node
+    inline const int32_t remote_bad_payload = -2;       ///<the function could not decode its arguments
+    inline const int32_t remote_no_node = -3;           ///<no node was connected, or all nodes failed
+    inline const int32_t remote_too_large = -4;         ///<the arguments or the result are larger than the receiver accepts
+
+    inline const uint32_t c_remote_magic = 0x534A4756;          ///<"VGJS", also detects nodes with a different byte order
+    inline const uint32_t c_remote_max_frame = 64u << 20;       ///<default limit, larger frames are taken as a broken connection
+    inline const uint32_t c_remote_min_frame = 4096;            ///<smallest limit a peer may announce
+
+    enum class remote_kind_t : uint32_t {
+        hello = 1,      ///<first frame in each direction, the body is the largest frame the sender accepts (uint32_t),
+                        ///<from the node m_count is the number of jobs it takes at once
+        jobs = 2,       ///<executor to node, entries are jobs, m_code is the type of the function
+        results = 3     ///<node to executor, entries are results, m_code is the status
+    };
+
+    /**
+    * \brief Header of a frame. Frames are sent in the byte order of the machine, all nodes must use the same.
+    */
+    struct remote_frame_t {
+        uint32_t m_magic = c_remote_magic;
+        uint32_t m_kind = 0;        ///<a remote_kind_t
+        uint32_t m_count = 0;       ///<number of entries
+        uint32_t m_size = 0;        ///<bytes following the header
+    };
+
+    /**
+    * \brief Header of one entry of a frame, followed by the payload, which is padded to 8 bytes.
+    */
+    struct remote_entry_t {
+        uint64_t m_id = 0;          ///<identifies the call, results carry the id of their job
+        int32_t  m_code = 0;        ///<type of the function for jobs, status for results
+        uint32_t m_size = 0;        ///<size of the payload in bytes
+    };
+
+    /**
+    * \brief Size of a payload including padding.
+    * \param[in] size Size of the payload.
+    * \returns the size rounded up to 8 bytes.
+    */
+    inline std::size_t remote_padded(std::size_t size) noexcept {
+        return (size + 7) & ~(std::size_t)7;
+    }
+
+    /**
+    * \brief Call a function for each entry of a received frame, with bounds checks.
+    * \param[in] body The bytes following the frame header.
+    * \param[in] count The number of entries.
+    * \param[in] f Called as f(const remote_entry_t&, uint32_t offset) with the offset of the payload in body.
+    * \returns false if the frame is malformed.
+    */
+    template<typename F>
+    inline bool remote_entries(const remote_bytes_t& body, uint32_t count, F&& f) {
+        std::size_t pos = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (body.size() - pos < sizeof(remote_entry_t)) return false;
+            remote_entry_t entry;
+            std::memcpy(&entry, body.data() + pos, sizeof(entry));
+            pos += sizeof(entry);
+            if (entry.m_size > body.size() - pos) return false;
+            f(entry, (uint32_t)pos);
+            pos = std::min(pos + remote_padded(entry.m_size), body.size());
+        }
+        return true;
+    }
+
+    /**
+    * \brief Size of an entry in a frame.
+    * \param[in] size Size of the payload.
+    * \returns the size of entry header and padded payload.
+    */
+    inline std::size_t remote_entry_size(std::size_t size) noexcept {
+        return sizeof(remote_entry_t) + remote_padded(size);
+    }
+
+    /**
+    * \brief Collects entries, so that many jobs or results are sent together.
+    */
+    class RemoteBatch {
+        remote_bytes_t  m_data;             ///<frame header and entries
+        uint32_t        m_count = 0;        ///<number of entries
+
+    public:
+        bool empty() const noexcept { return m_count == 0; }    ///<true if there is nothing to send
+
+        /**
+        * \brief Append an entry.
+        * \param[in] id Id of the call.
+        * \param[in] code Type of the function or status of the result.
+        * \param[in] payload The arguments or the result.
+        */
+        void add(uint64_t id, int32_t code, std::span<const std::byte> payload) {
+            if (m_data.empty()) m_data.resize(sizeof(remote_frame_t));      //room for the header
+            remote_entry_t entry{ id, code, (uint32_t)payload.size() };
+            std::size_t pos = m_data.size();
+            m_data.resize(pos + sizeof(entry) + remote_padded(payload.size()));
+            std::memcpy(m_data.data() + pos, &entry, sizeof(entry));
+            if (!payload.empty()) std::memcpy(m_data.data() + pos + sizeof(entry), payload.data(), payload.size());
+            ++m_count;
+        }
+
+        /**
+        * \brief Take the entries out of the batch.
+        * \param[out] count Receives the number of entries.
+        * \returns room for a frame header, followed by the entries.
+        */
+        remote_bytes_t finish(uint32_t& count) noexcept {
+            count = std::exchange(m_count, 0);
+            return std::move(m_data);
+        }
+
+        /**
+        * \brief Give a sent frame back, so its memory is used for the next one.
+        * \param[in] data The sent frame.
+        */
+        void recycle(remote_bytes_t&& data) noexcept {
+            if (m_count > 0 || data.capacity() <= m_data.capacity()) return;
+            data.clear();
+            m_data = std::move(data);
+        }
+    };
+
+
+    //---------------------------------------------------------------------------------------------------
+    //connections
+
+    /**
+    * \brief A TCP connection between an executor and a node.
+    *
+    * A receiver thread reads whole frames, each directly into one buffer of its own. The entries are handed
+    * on as views into this buffer, which is shared by all jobs and results of the frame, so payloads are never
+    * copied after they have been received. A sender thread sends everything that has been posted while the
+    * previous frame was being sent, so batches grow by themselves under load. Batches are split into frames
+    * no larger than the peer accepts, the peer announces its limit in its hello frame.
+    */
+    class RemoteLink : public std::enable_shared_from_this<RemoteLink> {
+    public:
+        using frame_handler_t = std::function<void(RemoteLink*, remote_kind_t, uint32_t, std::shared_ptr<remote_bytes_t>)>;
+        using close_handler_t = std::function<void(RemoteLink*)>;
+
+    private:
+        socket_t                m_socket;
+        remote_kind_t           m_kind;             ///<kind of the frames this side sends
+        std::mutex              m_mutex;            ///<protects the batch
+        std::condition_variable m_cv;               ///<wakes up the sender
+        RemoteBatch             m_batch;            ///<entries that wait for the sender
+        bool                    m_stop = false;     ///<the sender leaves, new entries are dropped
+        std::atomic<bool>       m_alive = true;     ///<false when the connection is broken
+        std::once_flag          m_closed;
+        std::thread             m_sender;
+        std::thread             m_receiver;
+        frame_handler_t         m_on_frame;
+        close_handler_t         m_on_close;
+        uint32_t                m_max_frame;        ///<larger frames break the connection
+        std::atomic<uint32_t>   m_peer_max_frame = c_remote_max_frame;  ///<largest frame the peer accepts
+
+        /**
+        * \brief Send a batch as frames that are not larger than the peer accepts.
+        * \param[in] data Room for a frame header, followed by the entries.
+        * \param[in] count Number of entries.
+        * \returns true if everything was sent.
+        */
+        bool send_frames(remote_bytes_t& data, uint32_t count) noexcept {
+            const std::size_t limit = m_peer_max_frame.load();
+            std::size_t pos = sizeof(remote_frame_t);           //first entry of the next frame
+            while (count > 0) {
+                std::size_t end = pos;
+                uint32_t num = 0;
+                while (num < count) {                           //post() only accepts entries that fit into a frame
+                    remote_entry_t entry;
+                    std::memcpy(&entry, data.data() + end, sizeof(entry));
+                    std::size_t size = remote_entry_size(entry.m_size);
+                    if (num > 0 && end - pos + size > limit) break;
+                    end += size;
+                    ++num;
+                }
+                remote_frame_t frame{ c_remote_magic, (uint32_t)m_kind, num, (uint32_t)(end - pos) };
+                std::memcpy(data.data() + pos - sizeof(frame), &frame, sizeof(frame));   //overwrites entries that have been sent already
+                if (!net_send_all(m_socket, data.data() + pos - sizeof(frame), end - pos + sizeof(frame))) return false;
+                pos = end;
+                count -= num;
+            }
+            return true;
+        }
+
+        /**
+        * \brief Loop of the sender thread.
+        */
+        void send_loop() noexcept {
+            while (true) {
+                remote_bytes_t data;
+                uint32_t count = 0;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv.wait(lock, [&]() { return m_stop || !m_batch.empty(); });
+                    if (m_stop) return;
+                    data = m_batch.finish(count);
+                }
+                if (!send_frames(data, count)) {
+                    net_shutdown(m_socket);         //the receiver sees this and closes the link
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_batch.recycle(std::move(data));
+            }
+        }
+
+        /**
+        * \brief Loop of the receiver thread.
+        */
+        void receive_loop() noexcept {
+            while (true) {
+                remote_frame_t frame;
+                if (!net_recv_all(m_socket, (std::byte*)&frame, sizeof(frame))) break;
+                if (frame.m_magic != c_remote_magic || frame.m_size > m_max_frame) break;   //checked before anything is allocated
+                auto body = std::make_shared<remote_bytes_t>(frame.m_size);     //the frame is received right into its final place
+                if (frame.m_size > 0 && !net_recv_all(m_socket, body->data(), body->size())) break;
+                if (frame.m_kind == (uint32_t)remote_kind_t::hello) {
+                    if (!set_peer_max_frame(*body)) break;
+                    continue;
+                }
+                m_on_frame(this, (remote_kind_t)frame.m_kind, frame.m_count, std::move(body));
+            }
+            m_alive = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_cv.notify_one();
+            if (m_on_close) m_on_close(this);
+        }
+
+    public:
+
+        /**
+        * \brief Constructor.
+        * \param[in] s A connected socket, now owned by the link.
+        * \param[in] kind The kind of the frames this side sends.
+        * \param[in] max_frame Largest frame that is received, in bytes.
+        */
+        RemoteLink(socket_t s, remote_kind_t kind, uint32_t max_frame = c_remote_max_frame) noexcept
+            : m_socket{ s }, m_kind{ kind }, m_max_frame{ max_frame } {}
+
+        RemoteLink(const RemoteLink&) = delete;
+
+        ~RemoteLink() { close(); }
+
+        /**
+        * \brief Start sending and receiving.
+        * \param[in] on_frame Called by the receiver thread for each received frame.
+        * \param[in] on_close Called by the receiver thread when the connection is broken.
+        */
+        void start(frame_handler_t on_frame, close_handler_t on_close = nullptr) {
+            m_on_frame = std::move(on_frame);
+            m_on_close = std::move(on_close);
+            m_sender = std::thread(&RemoteLink::send_loop, this);
+            m_receiver = std::thread(&RemoteLink::receive_loop, this);
+        }
+
+        /**
+        * \brief Queue an entry for sending. Entries of a broken link are dropped.
+        * \param[in] id Id of the call.
+        * \param[in] code Type of the function or status of the result.
+        * \param[in] payload The arguments or the result.
+        * \returns false if the entry is larger than a frame the peer accepts, such an entry is not sent.
+        */
+        bool post(uint64_t id, int32_t code, std::span<const std::byte> payload) noexcept {
+            if (payload.size() > m_peer_max_frame.load() || remote_entry_size(payload.size()) > m_peer_max_frame.load()) return false;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) return true;
+            bool wake = m_batch.empty();
+            m_batch.add(id, code, payload);
+            if (wake) m_cv.notify_one();
+            return true;
+        }
+
+        /**
+        * \brief Send the hello frame right away, before the link is started.
+        * \param[in] count Count of the frame, the number of jobs a node takes at once.
+        * \returns true if the frame was sent.
+        */
+        bool send_hello(uint32_t count) noexcept {
+            struct { remote_frame_t m_frame; uint32_t m_max_frame; } hello{ { c_remote_magic, (uint32_t)remote_kind_t::hello, count, sizeof(uint32_t) }, m_max_frame };
+            static_assert(sizeof(hello) == sizeof(remote_frame_t) + sizeof(uint32_t));
+            return net_send_all(m_socket, (const std::byte*)&hello, sizeof(hello));
+        }
+
+        /**
+        * \brief Take the frame limit of the peer from the body of its hello frame.
+        * \param[in] body The body of the hello frame.
+        * \returns false if the body is malformed.
+        */
+        bool set_peer_max_frame(const remote_bytes_t& body) noexcept {
+            uint32_t max_frame = 0;
+            if (body.size() != sizeof(max_frame)) return false;
+            std::memcpy(&max_frame, body.data(), sizeof(max_frame));
+            if (max_frame < c_remote_min_frame) return false;
+            m_peer_max_frame = max_frame;
+            return true;
+        }
+
+        bool alive() const noexcept { return m_alive.load(); }   ///<false when the connection is broken
+
+        /**
+        * \brief Break the connection without waiting, can be called from a handler of this link.
+        */
+        void shutdown() noexcept { net_shutdown(m_socket); }
+
+        /**
+        * \brief Break the connection and wait for both threads. Do not call from a handler of this link.
+        */
+        void close() noexcept {
+            std::call_once(m_closed, [&]() {
+                net_shutdown(m_socket);             //the receiver returns from recv()
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                }
+                m_cv.notify_one();
+                if (m_sender.joinable()) m_sender.join();
+                if (m_receiver.joinable()) m_receiver.join();
+                net_close(m_socket);
+                m_alive = false;
+            });
+        }
+    };
+
+
+    //---------------------------------------------------------------------------------------------------
+    //functions that can run remotely
+
+    using remote_function_t = std::function<std::optional<remote_bytes_t>(std::span<const std::byte>)>; ///<returns nullopt if the payload is bad
+
+    template<typename T>
+    concept REMOTE_VALUE = std::is_trivially_copyable_v<T> || std::is_same_v<std::decay_t<T>, remote_bytes_t>;  ///<can be sent to a node
+
+    /**
+    * \brief Serialize a value for sending.
+    * \param[in] value A trivially copyable value, or bytes.
+    * \returns the bytes.
+    */
+    template<REMOTE_VALUE T>
+    inline remote_bytes_t remote_encode(const T& value) {
+        if constexpr (std::is_same_v<T, remote_bytes_t>) {
+            return value;
+        }
+        else {
+            remote_bytes_t bytes(sizeof(T));
+            std::memcpy(bytes.data(), &value, sizeof(T));
+            return bytes;
+        }
+    }
+
+    /**
+    * \brief Deserialize a received value.
+    * \param[in] data The bytes.
+    * \returns the value, or nullopt if the size does not fit.
+    */
+    template<REMOTE_VALUE T>
+    inline std::optional<T> remote_decode(std::span<const std::byte> data) {
+        if constexpr (std::is_same_v<T, remote_bytes_t>) {
+            return remote_bytes_t(data.begin(), data.end());
+        }
+        else {
+            if (data.size() != sizeof(T)) return std::nullopt;
+            T value;
+            std::memcpy(&value, data.data(), sizeof(T));
+            return value;
+        }
+    }
+
+    /**
+    * \brief The functions that nodes of this process can run, by job type.
+    *
+    * Executor and nodes must agree on the types, e.g. by running the same program. Functions cannot be removed,
+    * so jobs can keep pointers to them.
+    */
+    class RemoteRegistry {
+        static inline std::mutex m_mutex;
+        static inline std::unordered_map<int32_t, remote_function_t> m_functions;   ///<nodes of the map never move
+
+    public:
+        /**
+        * \brief Register or replace the function for a type. Do not replace functions while nodes run them.
+        * \param[in] type The type, used as function id on the wire and as job type on the node.
+        * \param[in] f The function.
+        */
+        static void add(thread_type_t type, remote_function_t f) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_functions[type.value] = std::move(f);
+        }
+
+        /**
+        * \brief Find the function for a type.
+        * \param[in] type The type.
+        * \returns a pointer to the function, or nullptr.
+        */
+        static const remote_function_t* get(thread_type_t type) noexcept {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_functions.find(type.value);
+            return it == m_functions.end() ? nullptr : &it->second;
+        }
+    };
+
+    /**
+    * \brief Register a function that works on bytes.
+    * \param[in] type The type of the function.
+    * \param[in] f The function.
+    */
+    inline void register_remote(thread_type_t type, remote_function_t f) {
+        RemoteRegistry::add(type, std::move(f));
+    }
+
+    /**
+    * \brief Register a function that takes a value of type A and returns a value that can be sent back.
+    * \param[in] type The type of the function.
+    * \param[in] f The function, called as f(const A&).
+    */
+    template<REMOTE_VALUE A, typename F>
+    requires REMOTE_VALUE<std::invoke_result_t<F&, const A&>>
+    inline void register_remote(thread_type_t type, F f) {
+        RemoteRegistry::add(type, [f = std::move(f)](std::span<const std::byte> data) mutable -> std::optional<remote_bytes_t> {
+            auto arg = remote_decode<A>(data);
+            if (!arg) return std::nullopt;
+            return remote_encode(f(*arg));
+        });
+    }
+
+
+    //---------------------------------------------------------------------------------------------------
+    //nodes
+
+    /**
+    * \brief Where a RemoteNode listens and what it accepts. The protocol has no authentication,
+    * only make nodes reachable from trusted networks.
+    */
+    struct remote_node_options_t {
+        std::string m_address = "127.0.0.1";        ///<local address to listen on, "" for all interfaces
+        uint16_t    m_port = 0;                     ///<0 lets the OS choose a port, see RemoteNode::port()
+        uint32_t    m_capacity = 0;                 ///<jobs one executor can have on the node at once, 0 for twice the number of threads
+        uint32_t    m_max_frame = c_remote_max_frame;   ///<largest frame of jobs that is accepted, in bytes, at least c_remote_min_frame
+    };
+
+    /**
+    * \brief Runs jobs that executors send, in the job system of this process.
+    *
+    * A node listens on a port. After an executor has connected, the node tells it how many jobs it takes at
+    * once. Each result that goes back frees a slot, so nodes pull new jobs when they have time for them, and
+    * busy nodes are not sent more work than they can run. The jobs of a frame run as one batch of Functions
+    * with the type of their function, so they show up in the logs and metrics of the node.
+    */
+    class RemoteNode {
+        socket_t        m_listen = c_invalid_socket;
+        uint16_t        m_port = 0;
+        uint32_t        m_capacity;         ///<jobs one executor can have on this node at once
+        uint32_t        m_max_frame;        ///<largest frame of jobs that is accepted
+        std::thread     m_acceptor;
+        std::mutex      m_mutex;            ///<protects m_links
+        std::vector<std::shared_ptr<RemoteLink>> m_links;
+        std::atomic<bool> m_stop = false;
+
+        /**
+        * \brief Loop of the thread that accepts executors.
+        */
+        void accept_loop() noexcept {
+            while (!m_stop.load()) {
+                socket_t s = ::accept(m_listen, nullptr, nullptr);
+                if (s == c_invalid_socket) {
+#if !defined(_WIN32)
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+#endif
+                    return;
+                }
+                net_no_delay(s);
+                auto link = std::make_shared<RemoteLink>(s, remote_kind_t::results, m_max_frame);
+                if (!link->send_hello(m_capacity)) continue;       //the executor answers with its own hello before any jobs
+                link->start([](RemoteLink* l, remote_kind_t kind, uint32_t count, std::shared_ptr<remote_bytes_t> body) {
+                    if (kind == remote_kind_t::jobs) run(l->shared_from_this(), count, std::move(body));
+                });
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::erase_if(m_links, [](auto& l) { return !l->alive(); });
+                m_links.push_back(std::move(link));
+            }
+        }
+
+        /**
+        * \brief Schedule the jobs of a frame.
+        * \param[in] link The link the frame came from, results go back through it.
+        * \param[in] count Number of jobs.
+        * \param[in] body The entries, shared by all jobs.
+        */
+        static void run(std::shared_ptr<RemoteLink> link, uint32_t count, std::shared_ptr<remote_bytes_t> body) {
+            n_pmr::vector<Function> jobs;
+            jobs.reserve(count);
+            bool ok = remote_entries(*body, count, [&](const remote_entry_t& entry, uint32_t offset) {
+                const remote_function_t* f = RemoteRegistry::get(thread_type_t{ entry.m_code });
+                if (f == nullptr) {
+                    link->post(entry.m_id, remote_unknown_function, {});
+                    return;
+                }
+                jobs.emplace_back([=, id = entry.m_id, size = entry.m_size]() {
+                    auto result = (*f)(std::span<const std::byte>(body->data() + offset, size));   //a view into the received frame
+                    if (!result) link->post(id, remote_bad_payload, {});
+                    else if (!link->post(id, remote_ok, *result)) link->post(id, remote_too_large, {});  //more than the executor accepts
+                }, thread_index_t{}, thread_type_t{ entry.m_code });
+            });
+            if (!ok) link->shutdown();                          //a broken frame, drop the executor
+            if (!jobs.empty()) schedule(std::move(jobs));     //one batch
+        }
+
+    public:
+
+        /**
+        * \brief Start listening for executors.
+        * \param[in] options Address and port to listen on, capacity and frame limit. Listens on loopback by default.
+        */
+        RemoteNode(const remote_node_options_t& options = remote_node_options_t{}) noexcept
+            : m_capacity{ options.m_capacity > 0 ? options.m_capacity : 2 * (uint32_t)JobSystem().get_thread_count().value }
+            , m_max_frame{ options.m_max_frame } {
+            m_listen = net_listen(options.m_address, options.m_port, m_port);
+            if (m_listen != c_invalid_socket) m_acceptor = std::thread(&RemoteNode::accept_loop, this);
+        }
+
+        RemoteNode(const RemoteNode&) = delete;
+
+        /**
+        * \brief Stop accepting and close all connections. Jobs that are still running drop their results.
+        */
+        ~RemoteNode() {
+            m_stop = true;
+            if (m_listen != c_invalid_socket) {
+                net_shutdown(m_listen);             //accept() returns
+#if defined(_WIN32)
+                net_close(m_listen);
+#endif
+                m_acceptor.join();
+#if !defined(_WIN32)
+                net_close(m_listen);
+#endif
+            }
+            std::vector<std::shared_ptr<RemoteLink>> links;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                links.swap(m_links);
+            }
+            for (auto& link : links) link->close();
+        }
+
+        bool     is_listening() const noexcept { return m_listen != c_invalid_socket; }  ///<false if the port could not be used
+        uint16_t port() const noexcept { return m_port; }                                ///<the port the node listens on
+    };
+
+
+    //---------------------------------------------------------------------------------------------------
+    //executors
+
+    /**
+    * \brief The result of a remote call.
+    */
+    struct remote_result_t {
+        int32_t                                 m_status = remote_no_node;  ///<remote_ok, or why there is no result
+        std::shared_ptr<const remote_bytes_t>   m_frame;                    ///<the received frame that holds the result
+        std::span<const std::byte>              m_data;                     ///<the result, a view into m_frame
+
+        bool ok() const noexcept { return m_status == remote_ok; }         ///<true if the function ran
+    };
+
+    /**
+    * \brief A call that waits for a node. Lives in the awaitable, i.e. in the frame of the coro that waits for it.
+    */
+    struct remote_call_t {
+        thread_type_t   m_type;             ///<the function to run
+        remote_bytes_t  m_payload;          ///<its arguments
+        remote_result_t m_result;
+        uint64_t        m_id = 0;
+        Job_base*       m_job = nullptr;    ///<the coro to reschedule when the result is there
+    };
+
+    class RemoteExecutor;
+
+    /**
+    * \brief Awaitable for a remote call. Suspends the coro until the result has come back.
+    */
+    struct awaitable_remote : awaitable_external {
+        RemoteExecutor* m_executor;
+        remote_call_t   m_call;
+
+        bool await_ready() noexcept { return false; }
+
+        /**
+        * \brief Hand the call to the executor, which reschedules the coro when the result is there.
+        * \param[in] h The coro handle, can be used to get the promise.
+        */
+        template<typename P>
+        void await_suspend(n_exp::coroutine_handle<P> h) noexcept;
+
+        /**
+        * \brief Get the result of the call.
+        * \returns the result.
+        */
+        remote_result_t await_resume() noexcept { return std::move(m_call.m_result); }
+
+        awaitable_remote(RemoteExecutor* executor, thread_type_t type, remote_bytes_t&& payload) noexcept
+            : m_executor{ executor }, m_call{ type, std::move(payload), remote_result_t{} } {};
+    };
+
+    /**
+    * \brief Sends jobs to a pool of nodes and resumes the waiting coros when their results are back.
+    *
+    * Calls wait in one queue until a node has a free slot. Then they are posted to the node with the most free
+    * slots, and all calls posted while the previous frame is being sent travel together in one frame. If a node
+    * fails, its calls are handed to the other nodes. If no node is left, the calls end with remote_no_node.
+    */
+    class RemoteExecutor {
+        static inline const uint32_t c_max_batch = 256;    ///<at most this many calls are posted to a node at once
+
+        struct node_t {
+            std::shared_ptr<RemoteLink>                 m_link;
+            uint32_t                                    m_credit = 0;   ///<free slots on the node
+            std::unordered_map<uint64_t, remote_call_t*> m_in_flight;   ///<calls the node is working on
+        };
+
+        std::mutex                          m_mutex;        ///<protects everything below
+        std::vector<std::unique_ptr<node_t>> m_nodes;
+        std::deque<remote_call_t*>          m_pending;      ///<calls waiting for a free slot
+        uint64_t                            m_next_id = 1;
+        uint32_t                            m_max_frame;    ///<largest frame of results that is accepted
+
+        /**
+        * \brief Post waiting calls to the nodes with free slots. Call only with m_mutex locked.
+        * \param[out] failed Receives calls whose arguments are larger than the node accepts.
+        */
+        void dispatch(std::vector<remote_call_t*>& failed) noexcept {
+            while (!m_pending.empty()) {
+                node_t* best = nullptr;             //the node with most free slots pulls first
+                for (auto& node : m_nodes) {
+                    if (node->m_link->alive() && node->m_credit > 0 && (best == nullptr || node->m_credit > best->m_credit)) best = node.get();
+                }
+                if (best == nullptr) return;
+                uint32_t num = std::min({ best->m_credit, c_max_batch, (uint32_t)m_pending.size() });
+                best->m_credit -= num;
+                for (uint32_t i = 0; i < num; ++i) {
+                    remote_call_t* call = m_pending.front();
+                    m_pending.pop_front();
+                    if (!best->m_link->post(call->m_id, call->m_type.value, call->m_payload)) {
+                        ++best->m_credit;           //not sent, the slot is still free
+                        call->m_result = remote_result_t{ remote_too_large };
+                        failed.push_back(call);
+                        continue;
+                    }
+                    best->m_in_flight[call->m_id] = call;
+                }
+            }
+        }
+
+        /**
+        * \brief Take all waiting calls out if no node is left. Call only with m_mutex locked.
+        * \param[out] failed Receives the calls.
+        */
+        void fail_if_no_node(std::vector<remote_call_t*>& failed) noexcept {
+            for (auto& node : m_nodes) if (node->m_link->alive()) return;
+            failed.insert(failed.end(), m_pending.begin(), m_pending.end());
+            m_pending.clear();
+        }
+
+        /**
+        * \brief Reschedule the coros of calls. The calls must not be touched afterwards.
+        * \param[in] calls The finished calls.
+        */
+        static void complete(std::vector<remote_call_t*>& calls) noexcept {
+            for (auto* call : calls) JobSystem().schedule_job(call->m_job);
+        }
+
+        /**
+        * \brief A frame of results came in.
+        */
+        void on_results(node_t* node, uint32_t count, std::shared_ptr<remote_bytes_t> body) {
+            std::vector<remote_call_t*> done;
+            done.reserve(count);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::shared_ptr<const remote_bytes_t> frame = std::move(body);
+                remote_entries(*frame, count, [&](const remote_entry_t& entry, uint32_t offset) {
+                    auto it = node->m_in_flight.find(entry.m_id);
+                    if (it == node->m_in_flight.end()) return;
+                    remote_call_t* call = it->second;
+                    node->m_in_flight.erase(it);
+                    ++node->m_credit;               //the node has a free slot again
+                    call->m_result = remote_result_t{ entry.m_code, frame, std::span<const std::byte>(frame->data() + offset, entry.m_size) };
+                    done.push_back(call);
+                });
+                dispatch(done);
+            }
+            complete(done);
+        }
+
+        /**
+        * \brief A node failed, give its calls to the other nodes.
+        */
+        void on_close(node_t* node) {
+            std::vector<remote_call_t*> failed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& [id, call] : node->m_in_flight) m_pending.push_front(call);
+                node->m_in_flight.clear();
+                node->m_credit = 0;
+                fail_if_no_node(failed);
+                dispatch(failed);
+            }
+            complete(failed);
+        }
+
+    public:
+
+        /**
+        * \brief Constructor.
+        * \param[in] max_frame Largest frame of results that is accepted from a node, in bytes, at least c_remote_min_frame.
+        */
+        RemoteExecutor(uint32_t max_frame = c_remote_max_frame) noexcept : m_max_frame{ max_frame } {}
+
+        RemoteExecutor(const RemoteExecutor&) = delete;
+
+        /**
+        * \brief Disconnect from all nodes. Calls that have not finished end with remote_no_node.
+        */
+        ~RemoteExecutor() {
+            std::vector<std::shared_ptr<RemoteLink>> links;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& node : m_nodes) links.push_back(node->m_link);
+            }
+            for (auto& link : links) link->close();     //calls on_close() for each node
+            std::vector<remote_call_t*> failed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& node : m_nodes) for (auto& [id, call] : node->m_in_flight) failed.push_back(call);
+                failed.insert(failed.end(), m_pending.begin(), m_pending.end());
+                m_pending.clear();
+            }
+            complete(failed);
+        }
+
+        /**
+        * \brief Connect to a node. Blocks until the node has answered.
+        * \param[in] host Name or address of the node.
+        * \param[in] port Port of the node.
+        * \returns true if the node was added to the pool.
+        */
+        bool connect(const std::string& host, uint16_t port) noexcept {
+            socket_t s = net_connect(host, port);
+            if (s == c_invalid_socket) return false;
+            remote_frame_t hello;
+            remote_bytes_t limit(sizeof(uint32_t));
+            auto link = std::make_shared<RemoteLink>(s, remote_kind_t::jobs, m_max_frame);
+            if (!net_recv_all(s, (std::byte*)&hello, sizeof(hello)) || hello.m_magic != c_remote_magic
+                || hello.m_kind != (uint32_t)remote_kind_t::hello || hello.m_size != limit.size()
+                || !net_recv_all(s, limit.data(), limit.size()) || !link->set_peer_max_frame(limit) || !link->send_hello(0)) {
+                link->close();                      //closes the socket
+                return false;
+            }
+            auto node = std::make_unique<node_t>();
+            node_t* n = node.get();
+            node->m_link = std::move(link);
+            node->m_credit = std::max(hello.m_count, 1u);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_nodes.push_back(std::move(node));
+            }
+            n->m_link->start(
+                [this, n](RemoteLink*, remote_kind_t kind, uint32_t count, std::shared_ptr<remote_bytes_t> body) {
+                    if (kind == remote_kind_t::results) on_results(n, count, std::move(body));
+                },
+                [this, n](RemoteLink*) { on_close(n); });
+            std::vector<remote_call_t*> failed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                dispatch(failed);
+            }
+            complete(failed);
+            return true;
+        }
+
+        /**
+        * \brief Get the number of nodes that are connected.
+        * \returns the number of nodes.
+        */
+        uint32_t get_node_count() noexcept {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return (uint32_t)std::count_if(m_nodes.begin(), m_nodes.end(), [](auto& node) { return node->m_link->alive(); });
+        }
+
+        /**
+        * \brief Call a function on one of the nodes, use as co_await call(...).
+        * \param[in] type The type the function was registered with.
+        * \param[in] payload The arguments.
+        * \returns the awaitable, co_await returns a remote_result_t.
+        */
+        awaitable_remote call(thread_type_t type, remote_bytes_t payload) noexcept {
+            return { this, type, std::move(payload) };
+        }
+
+        /**
+        * \brief Queue a call. The coro in call->m_job is rescheduled when the result is there.
+        * \param[in] call The call, must stay valid until it has finished.
+        */
+        void submit(remote_call_t* call) noexcept {
+            std::vector<remote_call_t*> failed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                call->m_id = m_next_id++;
+                m_pending.push_back(call);
+                fail_if_no_node(failed);
+                dispatch(failed);
+            }
+            complete(failed);
+        }
+    };
+
+    template<typename P>
+    inline void awaitable_remote::await_suspend(n_exp::coroutine_handle<P> h) noexcept {
+        m_call.m_job = &h.promise();
+        m_executor->submit(&m_call);            //the coro may already run again when this returns
+    }
+
+    /**
+    * \brief Run a function on a node and get its result like from a local child.
+    *
+    * \param[in] executor The executor that sends the call.
+    * \param[in] type The type the function was registered with on the node.
+    * \param[in] arg The argument of the function.
+    * \returns a Coro with the result, or nullopt if the call failed.
+    */
+    template<REMOTE_VALUE R, REMOTE_VALUE A>
+    Coro<std::optional<R>> remote(RemoteExecutor& executor, thread_type_t type, A arg) {
+        remote_result_t result = co_await executor.call(type, remote_encode(arg));
+        if (!result.ok()) co_return std::nullopt;
+        co_return remote_decode<R>(result.m_data);
+    }
+
+}
+
+
+#endif